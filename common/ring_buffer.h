@@ -0,0 +1,150 @@
+#ifndef LCC_CV_COMMON_RING_BUFFER_H
+#define LCC_CV_COMMON_RING_BUFFER_H
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+namespace lcc_cv {
+
+// Bounded lock-free multi-producer multi-consumer queue. Each cell carries
+// a sequence number telling producers and consumers whose turn it is, so
+// TryPush/TryPop only need one compare-and-swap on the shared position.
+// Push/Pop spin with yield until they succeed or the queue is closed. Once
+// closed every push fails while pops still drain what is left; a push that
+// overlaps Close may land either way, so whoever closes a queue should do
+// it after its own producers are done.
+template<class T>
+class RingBuffer {
+ public:
+  explicit RingBuffer(int capacity);
+  ~RingBuffer() {
+    delete []cells_;
+  }
+  // Fails when the queue is full or closed.
+  bool TryPush(const T& value);
+  bool TryPop(T* value);
+  // Blocks while full; returns false once the queue is closed.
+  bool Push(const T& value);
+  // Blocks while empty; returns false once closed and drained.
+  bool Pop(T* value);
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+  }
+  bool IsClosed() {
+    return closed_.load(std::memory_order_acquire);
+  }
+  inline int GetCapacity() {
+    return static_cast<int>(mask_ + 1);
+  }
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    T value_;
+  };
+  RingBuffer(const RingBuffer&);
+  RingBuffer& operator=(const RingBuffer&);
+  Cell* cells_;
+  size_t mask_;
+  // Padding keeps producers and consumers off each other's cache line
+  // without over-aligning the type, which plain new cannot honour in C++11.
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[64];
+  std::atomic<bool> closed_;
+};
+
+template<class T>
+RingBuffer<T>::RingBuffer(int capacity) {
+  size_t size = 2;
+  while (size < static_cast<size_t>(capacity)) {
+    size <<= 1;
+  }
+  cells_ = new Cell[size];
+  for (size_t i = 0; i < size; ++i) {
+    cells_[i].sequence_.store(i, std::memory_order_relaxed);
+  }
+  mask_ = size - 1;
+  enqueue_pos_.store(0, std::memory_order_relaxed);
+  dequeue_pos_.store(0, std::memory_order_relaxed);
+  closed_.store(false, std::memory_order_relaxed);
+}
+
+template<class T>
+bool RingBuffer<T>::TryPush(const T& value) {
+  if (IsClosed()) {
+    return false;
+  }
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell& cell = cells_[pos & mask_];
+    size_t seq = cell.sequence_.load(std::memory_order_acquire);
+    std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq)
+                        - static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        cell.value_ = value;
+        cell.sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template<class T>
+bool RingBuffer<T>::TryPop(T* value) {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  for (;;) {
+    Cell& cell = cells_[pos & mask_];
+    size_t seq = cell.sequence_.load(std::memory_order_acquire);
+    std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq)
+                        - static_cast<std::ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        *value = cell.value_;
+        cell.value_ = T();
+        cell.sequence_.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template<class T>
+bool RingBuffer<T>::Push(const T& value) {
+  while (!TryPush(value)) {
+    if (IsClosed()) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+template<class T>
+bool RingBuffer<T>::Pop(T* value) {
+  while (!TryPop(value)) {
+    // Re-check after observing the close so a push that raced with it
+    // is not lost.
+    if (IsClosed()) {
+      return TryPop(value);
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+} // namespace lcc_cv
+
+#endif // LCC_CV_COMMON_RING_BUFFER_H
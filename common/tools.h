@@ -2,13 +2,16 @@
 #define LCC_CV_COMMON_TOOLS_H
 #include "opencv2/opencv.hpp"
 #include "common/type.h" 
+#include "common/profiler.h"
 
 namespace lcc_cv {
 void CvMat2Image (const cv::Mat& input_image,
                   std::shared_ptr<ImageByte> image) {
+  LCC_CV_PROFILE_SCOPE(kCvMat2Image);
   int channels = input_image.channels();
   int rows = input_image.rows;
   int cols = input_image.cols;
+  LCC_CV_PROFILE_PIXELS(kCvMat2Image, rows * cols * channels);
   for (int irow = 0; irow < rows; ++irow) {
     for (int icol = 0; icol < cols; ++icol) {
       for (int ichan = 0; ichan < channels; ++ichan) {
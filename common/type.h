@@ -10,8 +10,13 @@ template<class T>
 class Image {
  public:
   Image(int height, int width, int channel);
+  // Wraps an external buffer of height * width * channel elements without
+  // taking ownership; the buffer must outlive the image.
+  Image(int height, int width, int channel, T* data);
   ~Image() {
-    delete []data_;
+    if (own_data_) {
+      delete []data_;
+    }
   }
   T GetData(int row, int col, int channel);
   bool SetData(int row, int col, int channel, T value);
@@ -27,6 +32,10 @@ class Image {
   inline int GetSize() {
     return size_;  
   }
+  // Unchecked access to one row of one channel plane.
+  inline T* GetRow(int row, int channel) {
+    return data_ + width_ * (channel * height_ + row);
+  }
   Image<T> GetBlock(int left_up_row,
                     int left_up_col,
                     int right_down_row,
@@ -47,6 +56,7 @@ class Image {
   int width_;
   int channel_;
   T* data_;
+  bool own_data_;
 };
 
 template<class T>
@@ -56,9 +66,20 @@ Image<T>::Image(int height, int width, int channel) {
   channel_ = channel;
   size_ = height * width * channel;
   data_ = new T[size_];  
+  own_data_ = true;
   memset(data_, 0, size_ * sizeof(T));
 }
 
+template<class T>
+Image<T>::Image(int height, int width, int channel, T* data) {
+  height_ = height;  
+  width_ = width;
+  channel_ = channel;
+  size_ = height * width * channel;
+  data_ = data;
+  own_data_ = false;
+}
+
 template<class T>
 bool Image<T>::SetData(int row, int col, int channel, T value) {
   if (row < 0 || row > height_
@@ -68,6 +89,7 @@ bool Image<T>::SetData(int row, int col, int channel, T value) {
     return false;
   } else {
     data_[width_ * (channel * height_ + row) + col] = value;
+    return true;
   }
 }
 
@@ -3,6 +3,7 @@
 
 #include <math>
 #include "common/type.h"
+#include "common/profiler.h"
 
 namespace lcc_cv {
 typedef unsigned char Byte;
@@ -92,9 +93,11 @@ void SobelEdge::Init() {
 }
 void SobelEdge::Process(const std::shared_ptr<ImageByte>& input_image,
                         std::shared_ptr<ImageByte> edge_image) {
+  LCC_CV_PROFILE_SCOPE(kSobelEdge);
   int height = input_image->GetHeight();
   int width = input_image->GetWidth();
   int channel = input_image->GetChannel();
+  LCC_CV_PROFILE_PIXELS(kSobelEdge, input_image->GetSize());
   for (int irow = 0; irow < height; ++irow) {
     for (int icol = 0; icol < width; ++icol) {
       for (int ichan = 0; ichan < channel; ++ichan) {
@@ -137,6 +140,8 @@ void CannyEdge::Init() {
 }
 void CannyEdge::Process(const std::shared_ptr<ImageByte>& input_image,
                         std::shared_ptr<ImageByte> edge_image) {
+  LCC_CV_PROFILE_SCOPE(kCannyEdge);
+  LCC_CV_PROFILE_PIXELS(kCannyEdge, input_image->GetSize());
   std::shared_ptr<ImageByte> ampl_image;
   std::shared_ptr<ImageByte> ampl_image_2;
   std::shared_ptr<ImageByte> theta_image;
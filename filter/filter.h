@@ -1,15 +1,28 @@
 #ifndef LCC_CV_FILTER_FILTER_H
 #define LCC_CV_FILTER_FILTER_H
 #include "common/type.h"
+#include "common/profiler.h"
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 namespace lcc_cv {
 
+enum FilterType {
+  kMeanFilter = 0,
+  kGaussFilter,
+  kBilateralFilter,
+  // Bilateral approximated on a downsampled (x, y, intensity) grid.
+  kBilateralGridFilter
+};
+
 struct FilterOptions {
   int filter_type_;
   int kernel_size_;
   float sigma_;
+  // Range sigma in intensity levels, only read by BilateralFilter.
+  float sigma_color_;
 };
 typedef unsigned char Byte;
 class Filter {
@@ -23,16 +36,28 @@ class Filter {
                            int row,
                            int col,
                            int chan) = 0;
-  void Process(const std::shared_ptr<ImageByte >& input_image,
+  virtual void Process(const std::shared_ptr<ImageByte >& input_image,
                std::shared_ptr<ImageByte > filtered_image);
  protected:
   void BoundaryProcess(const std::shared_ptr<ImageByte >& input_image,
                        std::shared_ptr<ImageByte > filtered_image); 
+  // Pixels Process convolves, the border excluded.
+  size_t InnerSize(const std::shared_ptr<ImageByte >& input_image) {
+    int k = (kernel_size_ - 1) / 2;
+    int rows = std::max(0, input_image -> GetHeight() - 2 * k);
+    int cols = std::max(0, input_image -> GetWidth() - 2 * k);
+    return (size_t)rows * cols * input_image -> GetChannel();
+  }
+  // Heap bytes one KernelConv call allocates.
+  virtual size_t KernelBytes() {
+    return 0;
+  }
   int kernel_size_;
 };
 
-void Filter::BoundaryProcess(const std::shared_ptr<ImageByte >& input_image,
+inline void Filter::BoundaryProcess(const std::shared_ptr<ImageByte >& input_image,
                              std::shared_ptr<ImageByte > filtered_image) {
+  LCC_CV_PROFILE_SCOPE(kFilterBoundary);
   int k = (kernel_size_ - 1) / 2;
   int left_up_row = 0;
   int left_up_col = 0;
@@ -74,10 +99,13 @@ void Filter::BoundaryProcess(const std::shared_ptr<ImageByte >& input_image,
                              
 }
 
-void Filter::Process(const std::shared_ptr<ImageByte>& input_image,
+inline void Filter::Process(const std::shared_ptr<ImageByte>& input_image,
                          std::shared_ptr<ImageByte> filtered_image) {
+  LCC_CV_PROFILE_SCOPE(kFilterProcess);
   int k = (kernel_size_ - 1) / 2;
   BoundaryProcess(input_image, filtered_image);
+  LCC_CV_PROFILE_PIXELS(kFilterProcess, InnerSize(input_image));
+  LCC_CV_PROFILE_BYTES(kFilterProcess, InnerSize(input_image) * KernelBytes());
   for (int irow = k; irow < input_image -> GetHeight() - k; ++irow) {
     for (int icol = k; icol < input_image -> GetWidth() - k; ++icol) {
       for (int ichan =0; ichan < input_image -> GetChannel(); ++ichan) {
@@ -97,9 +125,12 @@ class MeanFilter : public Filter {
                    int col,
                    int chan);
  private:
+  size_t KernelBytes() {
+    return kernel_size_ * sizeof(float);
+  }
 };
 
-float MeanFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
+inline float MeanFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
                             int row,
                             int col,
                             int chan) {
@@ -132,11 +163,14 @@ class GaussFilter : public Filter {
                    int col,
                    int chan);
  private:
+  size_t KernelBytes() {
+    return kernel_size_ * sizeof(float);
+  }
   float coff_;
   std::vector<float> row_kernel_;
 };
 
-void GaussFilter::Init(FilterOptions filter_options) {
+inline void GaussFilter::Init(FilterOptions filter_options) {
   kernel_size_ = filter_options.kernel_size_;
   float sigma = filter_options.sigma_;
   row_kernel_.resize(kernel_size_);
@@ -148,7 +182,7 @@ void GaussFilter::Init(FilterOptions filter_options) {
   coff_ = 2 * PI * sigma * sigma;
 }
 
-float GaussFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
+inline float GaussFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
                             int row,
                             int col,
                             int chan) {
@@ -170,5 +204,246 @@ float GaussFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
   return sum;
 }
 
+const float kBilateralMinSigma = 0.1;
+// Grid cells smaller than this cost more memory than the exact filter
+// costs time.
+const float kBilateralGridMinSigma = 2.0;
+const float kBilateralGridMinSigmaColor = 16.0;
+// Cells of one grid, 8 MB. Larger planes get wider spatial cells.
+const size_t kBilateralGridMaxCells = 1 << 20;
+
+// Downsampled (x, y, intensity) grid of one image channel for the
+// approximate bilateral filter: cells are sigma_space pixels wide and
+// sigma_color levels deep, widened spatially when the grid would exceed
+// kBilateralGridMaxCells. The cells live in storage owned by the caller,
+// so a thread can reuse them across channels and frames.
+class BilateralGrid {
+ public:
+  BilateralGrid(float sigma_space, float sigma_color, std::vector<float>* cells)
+      : sigma_space_(sigma_space), sigma_color_(sigma_color), cells_(*cells) {}
+  ~BilateralGrid() {}
+  // Splats every pixel of chan into its nearest cell, then blurs the cells.
+  void Build(const std::shared_ptr<ImageByte >& input_image, int chan);
+  // Trilinear lookup at (row, col, value) of the built grid.
+  float Slice(int row, int col, int value);
+  // Spatial cell size after the cap, valid after Build.
+  inline float GetSigmaSpace() {
+    return sigma_space_;
+  }
+ private:
+  void Blur(int axis);
+  inline size_t CellIndex(size_t z, size_t y, size_t x) {
+    return ((z * height_ + y) * width_ + x) * 2;
+  }
+  float sigma_space_;
+  float sigma_color_;
+  size_t width_;
+  size_t height_;
+  size_t depth_;
+  // Interleaved (weighted sum, weight) per cell.
+  std::vector<float>& cells_;
+};
+
+inline void BilateralGrid::Build(const std::shared_ptr<ImageByte >& input_image,
+                                 int chan) {
+  int height = input_image -> GetHeight();
+  int width = input_image -> GetWidth();
+  // One cell of padding on each side keeps splatting, blurring and
+  // interpolation inside the grid.
+  depth_ = static_cast<size_t>(255 / sigma_color_) + 4;
+  for (;;) {
+    width_ = static_cast<size_t>((width - 1) / sigma_space_) + 4;
+    height_ = static_cast<size_t>((height - 1) / sigma_space_) + 4;
+    if (depth_ * height_ * width_ <= kBilateralGridMaxCells) {
+      break;
+    }
+    sigma_space_ *= 1.1f;
+  }
+  size_t size = depth_ * height_ * width_ * 2;
+  if (size > cells_.capacity()) {
+    LCC_CV_PROFILE_BYTES(kFilterProcess,
+                         (size - cells_.capacity()) * sizeof(float));
+  }
+  cells_.assign(size, 0);
+  for (int irow = 0; irow < height; ++irow) {
+    const Byte* input_row = input_image -> GetRow(irow, chan);
+    size_t y = static_cast<size_t>(irow / sigma_space_ + 0.5) + 1;
+    for (int icol = 0; icol < width; ++icol) {
+      size_t x = static_cast<size_t>(icol / sigma_space_ + 0.5) + 1;
+      size_t z = static_cast<size_t>(input_row[icol] / sigma_color_ + 0.5) + 1;
+      float* cell = &cells_[CellIndex(z, y, x)];
+      cell[0] += input_row[icol];
+      cell[1] += 1;
+    }
+  }
+  for (int axis = 0; axis < 3; ++axis) {
+    Blur(axis);
+  }
+}
+
+// [1 2 1] / 4 along one grid axis: 0 for x, 1 for y, 2 for intensity.
+inline void BilateralGrid::Blur(int axis) {
+  size_t size[3] = {width_, height_, depth_};
+  size_t stride[3] = {2, width_ * 2, width_ * height_ * 2};
+  size_t length = size[axis];
+  size_t step = stride[axis];
+  std::vector<float> line_copy(length * 2);
+  for (size_t z = 0; z < (axis == 2 ? 1 : depth_); ++z) {
+    for (size_t y = 0; y < (axis == 1 ? 1 : height_); ++y) {
+      for (size_t x = 0; x < (axis == 0 ? 1 : width_); ++x) {
+        float* line = &cells_[CellIndex(z, y, x)];
+        for (size_t i = 0; i < length; ++i) {
+          line_copy[2 * i] = line[i * step];
+          line_copy[2 * i + 1] = line[i * step + 1];
+        }
+        for (size_t i = 0; i < length; ++i) {
+          for (int j = 0; j < 2; ++j) {
+            float sum = 2 * line_copy[2 * i + j];
+            if (i > 0) {
+              sum += line_copy[2 * (i - 1) + j];
+            }
+            if (i < length - 1) {
+              sum += line_copy[2 * (i + 1) + j];
+            }
+            line[i * step + j] = sum / 4;
+          }
+        }
+      }
+    }
+  }
+}
+
+inline float BilateralGrid::Slice(int row, int col, int value) {
+  float fx = col / sigma_space_ + 1;
+  float fy = row / sigma_space_ + 1;
+  float fz = value / sigma_color_ + 1;
+  size_t x = static_cast<size_t>(fx);
+  size_t y = static_cast<size_t>(fy);
+  size_t z = static_cast<size_t>(fz);
+  float ax = fx - x;
+  float ay = fy - y;
+  float az = fz - z;
+  float sum = 0.0;
+  float weight_sum = 0.0;
+  for (int iz = 0; iz < 2; ++iz) {
+    for (int iy = 0; iy < 2; ++iy) {
+      for (int ix = 0; ix < 2; ++ix) {
+        float w = (iz ? az : 1 - az) * (iy ? ay : 1 - ay) * (ix ? ax : 1 - ax);
+        const float* cell = &cells_[CellIndex(z + iz, y + iy, x + ix)];
+        sum += w * cell[0];
+        weight_sum += w * cell[1];
+      }
+    }
+  }
+  if (weight_sum <= 0) {
+    return value;
+  }
+  return sum / weight_sum + 0.5;
+}
+
+// Edge preserving smoothing: each neighbour is weighted by its distance
+// (sigma_) and by its intensity difference to the centre (sigma_color_).
+// Both weights come from tables built in Init, so the exact path
+// (KernelConv) has no exp in the inner loop. With filter_type_
+// kBilateralGridFilter, Process builds a BilateralGrid per channel and
+// interpolates it instead; its cost hardly depends on sigma_, and
+// kernel_size_ then only sets the unfiltered border. The grid cells are
+// per thread, so one instance may run Process on several threads at once.
+class BilateralFilter : public Filter {
+ public:
+  BilateralFilter() : approximate_(false) {}
+  ~BilateralFilter() {}
+  void Init(FilterOptions filter_options);
+  float KernelConv(const std::shared_ptr<ImageByte >& input_image,
+                   int row,
+                   int col,
+                   int chan);
+  void Process(const std::shared_ptr<ImageByte >& input_image,
+               std::shared_ptr<ImageByte > filtered_image);
+ private:
+  bool approximate_;
+  float sigma_space_;
+  float sigma_color_;
+  std::vector<float> space_weight_;
+  float color_weight_[256];
+};
+
+inline void BilateralFilter::Init(FilterOptions filter_options) {
+  kernel_size_ = filter_options.kernel_size_;
+  approximate_ = filter_options.filter_type_ == kBilateralGridFilter;
+  sigma_space_ = filter_options.sigma_;
+  sigma_color_ = filter_options.sigma_color_;
+  float min_sigma = approximate_ ? kBilateralGridMinSigma : kBilateralMinSigma;
+  float min_sigma_color = approximate_ ? kBilateralGridMinSigmaColor
+                                       : kBilateralMinSigma;
+  // Negated compares also catch NaN.
+  if (!(sigma_space_ >= min_sigma)) {
+    std::cout << "sigma too small, use " << min_sigma << std::endl;
+    sigma_space_ = min_sigma;
+  }
+  if (!(sigma_color_ >= min_sigma_color)) {
+    std::cout << "sigma_color too small, use " << min_sigma_color << std::endl;
+    sigma_color_ = min_sigma_color;
+  }
+  int k = (kernel_size_ - 1) / 2;
+  space_weight_.resize(kernel_size_ * kernel_size_);
+  for (int irow = -k; irow <= k; ++irow) {
+    for (int icol = -k; icol <= k; ++icol) {
+      float dist2 = (irow * irow + icol * icol) / (sigma_space_ * sigma_space_);
+      space_weight_[(irow + k) * kernel_size_ + icol + k] = exp(-dist2 / 2);
+    }
+  }
+  for (int idiff = 0; idiff < 256; ++idiff) {
+    float temp = idiff / sigma_color_;
+    color_weight_[idiff] = exp(-temp * temp / 2);
+  }
+}
+
+inline float BilateralFilter::KernelConv(const std::shared_ptr<ImageByte >& input_image,
+                                  int row,
+                                  int col,
+                                  int chan) {
+  int k = (kernel_size_ - 1) / 2;
+  int center = input_image -> GetRow(row, chan)[col];
+  const float* space = &space_weight_[0];
+  float sum = 0.0;
+  float weight_sum = 0.0;
+  for (int irow = row - k; irow <= row + k; ++irow) {
+    const Byte* input_row = input_image -> GetRow(irow, chan);
+    for (int icol = col - k; icol <= col + k; ++icol, ++space) {
+      int value = input_row[icol];
+      float w = *space * color_weight_[abs(value - center)];
+      sum += w * value;
+      weight_sum += w;
+    }
+  }
+  return sum / weight_sum + 0.5;
+}
+
+inline void BilateralFilter::Process(const std::shared_ptr<ImageByte>& input_image,
+                              std::shared_ptr<ImageByte> filtered_image) {
+  if (!approximate_) {
+    Filter::Process(input_image, filtered_image);
+    return;
+  }
+  LCC_CV_PROFILE_SCOPE(kFilterProcess);
+  LCC_CV_PROFILE_PIXELS(kFilterProcess, InnerSize(input_image));
+  // Kept for the thread's next channel and frame instead of reallocated.
+  static thread_local std::vector<float> cells;
+  int k = (kernel_size_ - 1) / 2;
+  BoundaryProcess(input_image, filtered_image);
+  for (int ichan =0; ichan < input_image -> GetChannel(); ++ichan) {
+    BilateralGrid grid(sigma_space_, sigma_color_, &cells);
+    grid.Build(input_image, ichan);
+    for (int irow = k; irow < input_image -> GetHeight() - k; ++irow) {
+      const Byte* input_row = input_image -> GetRow(irow, ichan);
+      for (int icol = k; icol < input_image -> GetWidth() - k; ++icol) {
+        float conv_result = grid.Slice(irow, icol, input_row[icol]);
+        filtered_image -> SetData(irow, icol, ichan, static_cast<Byte>(conv_result));
+      }
+    }
+  }
+}
+
 }
 #endif // LCC_CV_FILTER_FILTER_H
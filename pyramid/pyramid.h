@@ -0,0 +1,212 @@
+#ifndef LCC_CV_PYRAMID_PYRAMID_H
+#define LCC_CV_PYRAMID_PYRAMID_H
+#include <vector>
+#include "common/type.h"
+#include "common/profiler.h"
+
+namespace lcc_cv {
+typedef unsigned char Byte;
+
+// Maps an index outside [0, size) back inside by mirroring around the edge
+// pixel without repeating it: dcb|abcd|cba.
+inline int Reflect101(int index, int size) {
+  if (size == 1) {
+    return 0;
+  }
+  while (index < 0 || index >= size) {
+    if (index < 0) {
+      index = -index;
+    }
+    if (index >= size) {
+      index = 2 * size - 2 - index;
+    }
+  }
+  return index;
+}
+
+// Blurs with the 5x5 binomial kernel [1 4 6 4 1]^2 / 256 and keeps every
+// second row and column. Only the retained rows are filtered vertically and
+// only the retained columns horizontally, so the cost is about a quarter of
+// a full resolution blur. down_image must be (h + 1) / 2 by (w + 1) / 2.
+inline bool PyrDown(const std::shared_ptr<ImageByte>& input_image,
+                    std::shared_ptr<ImageByte> down_image) {
+  int height = input_image->GetHeight();
+  int width = input_image->GetWidth();
+  int channel = input_image->GetChannel();
+  int down_height = down_image->GetHeight();
+  int down_width = down_image->GetWidth();
+  if (down_height != (height + 1) / 2
+      || down_width != (width + 1) / 2
+      || channel != down_image->GetChannel()) {
+    std::cout << "region doesn't match" << std::endl;
+    return false;
+  }
+  LCC_CV_PROFILE_SCOPE(kPyrDown);
+  LCC_CV_PROFILE_PIXELS(kPyrDown, down_image->GetSize());
+  // Column sums padded by two on each side so the horizontal taps need no
+  // border checks.
+  std::vector<int> col_sum(width + 4);
+  int* sum = &col_sum[2];
+  for (int ichan = 0; ichan < channel; ++ichan) {
+    for (int irow = 0; irow < down_height; ++irow) {
+      const Byte* row0 = input_image->GetRow(Reflect101(2 * irow - 2, height), ichan);
+      const Byte* row1 = input_image->GetRow(Reflect101(2 * irow - 1, height), ichan);
+      const Byte* row2 = input_image->GetRow(2 * irow, ichan);
+      const Byte* row3 = input_image->GetRow(Reflect101(2 * irow + 1, height), ichan);
+      const Byte* row4 = input_image->GetRow(Reflect101(2 * irow + 2, height), ichan);
+      for (int icol = 0; icol < width; ++icol) {
+        sum[icol] = row0[icol] + row4[icol]
+                  + 4 * (row1[icol] + row3[icol]) + 6 * row2[icol];
+      }
+      for (int ipad = 1; ipad <= 2; ++ipad) {
+        sum[-ipad] = sum[Reflect101(-ipad, width)];
+        sum[width - 1 + ipad] = sum[Reflect101(width - 1 + ipad, width)];
+      }
+      Byte* down_row = down_image->GetRow(irow, ichan);
+      for (int icol = 0; icol < down_width; ++icol) {
+        const int* tap = sum + 2 * icol;
+        down_row[icol] = static_cast<Byte>((tap[-2] + tap[2]
+                                            + 4 * (tap[-1] + tap[1])
+                                            + 6 * tap[0] + 128) >> 8);
+      }
+    }
+  }
+  return true;
+}
+
+// Doubles one row: even outputs take [1 6 1] around a source pixel, odd
+// outputs [4 4] between two, i.e. the zero-stuffed [1 4 6 4 1] kernel.
+inline void PyrUpRow(const Byte* input_row, int width, int* up_row) {
+  for (int icol = 1; icol < width - 1; ++icol) {
+    up_row[2 * icol] = input_row[icol - 1] + 6 * input_row[icol]
+                     + input_row[icol + 1];
+    up_row[2 * icol + 1] = 4 * (input_row[icol] + input_row[icol + 1]);
+  }
+  int border[2] = {0, width - 1};
+  for (int iside = 0; iside < 2; ++iside) {
+    int icol = border[iside];
+    int left = input_row[Reflect101(icol - 1, width)];
+    int right = input_row[Reflect101(icol + 1, width)];
+    up_row[2 * icol] = left + 6 * input_row[icol] + right;
+    up_row[2 * icol + 1] = 4 * (input_row[icol] + right);
+  }
+}
+
+// Upsamples by two with the same kernel as PyrDown, scaled by four to keep
+// the brightness. up_image must be 2h by 2w.
+inline bool PyrUp(const std::shared_ptr<ImageByte>& input_image,
+                  std::shared_ptr<ImageByte> up_image) {
+  int height = input_image->GetHeight();
+  int width = input_image->GetWidth();
+  int channel = input_image->GetChannel();
+  int up_width = up_image->GetWidth();
+  if (up_image->GetHeight() != 2 * height
+      || up_width != 2 * width
+      || channel != up_image->GetChannel()) {
+    std::cout << "region doesn't match" << std::endl;
+    return false;
+  }
+  LCC_CV_PROFILE_SCOPE(kPyrUp);
+  LCC_CV_PROFILE_PIXELS(kPyrUp, up_image->GetSize());
+  // Horizontally upsampled source rows irow - 1, irow and irow + 1, rotated
+  // as irow advances so every source row is upsampled once.
+  std::vector<int> row_buffer(3 * up_width);
+  for (int ichan = 0; ichan < channel; ++ichan) {
+    int* prev = &row_buffer[0];
+    int* cur = &row_buffer[up_width];
+    int* next = &row_buffer[2 * up_width];
+    PyrUpRow(input_image->GetRow(Reflect101(-1, height), ichan), width, prev);
+    PyrUpRow(input_image->GetRow(0, ichan), width, cur);
+    PyrUpRow(input_image->GetRow(Reflect101(1, height), ichan), width, next);
+    for (int irow = 0; irow < height; ++irow) {
+      Byte* even_row = up_image->GetRow(2 * irow, ichan);
+      Byte* odd_row = up_image->GetRow(2 * irow + 1, ichan);
+      for (int icol = 0; icol < up_width; ++icol) {
+        even_row[icol] = static_cast<Byte>(
+            (prev[icol] + 6 * cur[icol] + next[icol] + 32) >> 6);
+        odd_row[icol] = static_cast<Byte>(
+            (4 * (cur[icol] + next[icol]) + 32) >> 6);
+      }
+      if (irow + 1 < height) {
+        int* temp = prev;
+        prev = cur;
+        cur = next;
+        next = temp;
+        PyrUpRow(input_image->GetRow(Reflect101(irow + 2, height), ichan),
+                 width, next);
+      }
+    }
+  }
+  return true;
+}
+
+// Deletes a level view and drops its reference on the shared buffer.
+struct PyramidLevelDeleter {
+  std::shared_ptr<Byte> buffer_;
+  void operator()(ImageByte* image) {
+    delete image;
+  }
+};
+
+// Gaussian pyramid. Level 0 is the base image itself, every further level
+// is PyrDown of the previous one. All downsampled levels are views into a
+// single buffer, and each level keeps that buffer alive, so a level stays
+// valid after the next Build or after the pyramid is destroyed. Build
+// reuses the buffer only when no level of the previous build is still
+// held outside the pyramid.
+class ImagePyramid {
+ public:
+  ImagePyramid() : buffer_size_(0) {}
+  ~ImagePyramid() {}
+  // Stops early once a level reaches 1x1.
+  void Build(const std::shared_ptr<ImageByte>& base_image, int levels);
+  inline std::shared_ptr<ImageByte> GetLevel(int level) {
+    return levels_[level];
+  }
+  inline int GetLevels() {
+    return levels_.size();
+  }
+ private:
+  ImagePyramid(const ImagePyramid&);
+  ImagePyramid& operator=(const ImagePyramid&);
+  std::vector<std::shared_ptr<ImageByte> > levels_;
+  std::shared_ptr<Byte> buffer_;
+  size_t buffer_size_;
+};
+
+inline void ImagePyramid::Build(const std::shared_ptr<ImageByte>& base_image,
+                                int levels) {
+  int channel = base_image->GetChannel();
+  std::vector<int> heights(1, base_image->GetHeight());
+  std::vector<int> widths(1, base_image->GetWidth());
+  size_t total_size = 0;
+  while ((int)heights.size() < levels
+         && (heights.back() > 1 || widths.back() > 1)) {
+    heights.push_back((heights.back() + 1) / 2);
+    widths.push_back((widths.back() + 1) / 2);
+    total_size += (size_t)heights.back() * widths.back() * channel;
+  }
+  levels_.clear();
+  if (total_size > buffer_size_ || !buffer_.unique()) {
+    buffer_.reset(new Byte[total_size], std::default_delete<Byte[]>());
+    buffer_size_ = total_size;
+  }
+  levels_.push_back(base_image);
+  PyramidLevelDeleter deleter;
+  deleter.buffer_ = buffer_;
+  size_t offset = 0;
+  for (size_t ilevel = 1; ilevel < heights.size(); ++ilevel) {
+    std::shared_ptr<ImageByte> level(new ImageByte(heights[ilevel],
+                                                   widths[ilevel],
+                                                   channel,
+                                                   buffer_.get() + offset),
+                                     deleter);
+    PyrDown(levels_.back(), level);
+    levels_.push_back(level);
+    offset += (size_t)heights[ilevel] * widths[ilevel] * channel;
+  }
+}
+
+} // namespace lcc_cv
+
+#endif // LCC_CV_PYRAMID_PYRAMID_H
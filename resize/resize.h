@@ -0,0 +1,304 @@
+#ifndef LCC_CV_RESIZE_RESIZE_H
+#define LCC_CV_RESIZE_RESIZE_H
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "common/type.h"
+#include "common/profiler.h"
+
+namespace lcc_cv {
+typedef unsigned char Byte;
+
+enum ResizeType {
+  kResizeBilinear = 0,
+  // Averages the covered source pixels; falls back to bilinear when
+  // enlarging.
+  kResizeArea
+};
+
+struct ResizeOptions {
+  int resize_type_;
+  int src_height_;
+  int src_width_;
+  int dst_height_;
+  int dst_width_;
+};
+
+// Fractional bits of the fixed point weights, per direction. The
+// horizontal pass keeps one bit less (15 in all) so that its results fit
+// int16 and the vertical pass can multiply-add them in pairs.
+const int kResizeBits = 8;
+
+// Separable resize driven by fixed point tables built once in Init: each
+// output column (row) reads a fixed number of taps, each a source index
+// and a weight, and the weights of one output sum to 1 << kResizeBits.
+// Taps are processed in pairs, which maps onto the SSE2 multiply-add of
+// int16 pairs; without SSE2 the same arithmetic runs in scalar code and
+// gives identical results.
+//
+// Process filters each source row horizontally at most once per channel
+// into a rolling window of row_taps_ rows allocated per call, then blends
+// the rows of the window vertically. Init is the only writer, so one
+// Resizer may run Process on several threads at once.
+class Resizer {
+ public:
+  Resizer() {}
+  ~Resizer() {}
+  void Init(ResizeOptions resize_options);
+  bool Process(const std::shared_ptr<ImageByte>& input_image,
+               std::shared_ptr<ImageByte> resized_image);
+ private:
+  void BuildTable(int src_size,
+                  int dst_size,
+                  std::vector<int>* index,
+                  std::vector<int>* weight,
+                  int* taps);
+  void HorizontalPass(const Byte* input_row, short* row);
+  void VerticalPass(const short* const* rows,
+                    const short* weight,
+                    Byte* resized_row);
+  ResizeOptions options_;
+  // dst_width_ rounded up to a multiple of 8, the width of a window row.
+  int padded_width_;
+  int col_pairs_;
+  // Per block of 4 output columns and per tap pair, 4 (first, second)
+  // source columns and their weights.
+  std::vector<int> col_index_;
+  std::vector<short> col_weight_;
+  int row_taps_;
+  int row_pairs_;
+  // Per output row, 2 * row_pairs_ source rows and their weights.
+  std::vector<int> row_index_;
+  std::vector<short> row_weight_;
+};
+
+inline void Resizer::Init(ResizeOptions resize_options) {
+  options_ = resize_options;
+  std::vector<int> index;
+  std::vector<int> weight;
+  int col_taps;
+  BuildTable(options_.src_width_, options_.dst_width_,
+             &index, &weight, &col_taps);
+  // Odd tap counts get a zero weight tap on the first source column.
+  col_pairs_ = (col_taps + 1) / 2;
+  padded_width_ = (options_.dst_width_ + 7) / 8 * 8;
+  col_index_.assign((size_t)padded_width_ * col_pairs_ * 2, 0);
+  col_weight_.assign(col_index_.size(), 0);
+  for (int icol = 0; icol < options_.dst_width_; ++icol) {
+    for (int itap = 0; itap < 2 * col_pairs_; ++itap) {
+      size_t entry = ((size_t)(icol / 4 * col_pairs_ + itap / 2) * 4
+                      + icol % 4) * 2 + itap % 2;
+      if (itap < col_taps) {
+        col_index_[entry] = index[icol * col_taps + itap];
+        col_weight_[entry] = weight[icol * col_taps + itap];
+      } else {
+        col_index_[entry] = index[icol * col_taps];
+      }
+    }
+  }
+  BuildTable(options_.src_height_, options_.dst_height_,
+             &index, &weight, &row_taps_);
+  row_pairs_ = (row_taps_ + 1) / 2;
+  row_index_.assign((size_t)options_.dst_height_ * row_pairs_ * 2, 0);
+  row_weight_.assign(row_index_.size(), 0);
+  for (int irow = 0; irow < options_.dst_height_; ++irow) {
+    for (int itap = 0; itap < 2 * row_pairs_; ++itap) {
+      size_t entry = (size_t)irow * row_pairs_ * 2 + itap;
+      if (itap < row_taps_) {
+        row_index_[entry] = index[irow * row_taps_ + itap];
+        row_weight_[entry] = weight[irow * row_taps_ + itap];
+      } else {
+        row_index_[entry] = index[irow * row_taps_];
+      }
+    }
+  }
+}
+
+inline void Resizer::BuildTable(int src_size,
+                                int dst_size,
+                                std::vector<int>* index,
+                                std::vector<int>* weight,
+                                int* taps) {
+  double scale = (double)src_size / dst_size;
+  int one = 1 << kResizeBits;
+  if (options_.resize_type_ == kResizeArea && scale > 1) {
+    *taps = (int)ceil(scale) + 1;
+    index->assign(dst_size * *taps, 0);
+    weight->assign(dst_size * *taps, 0);
+    for (int idst = 0; idst < dst_size; ++idst) {
+      double begin = idst * scale;
+      double end = std::min((idst + 1) * scale, (double)src_size);
+      int first = (int)floor(begin);
+      int sum = 0;
+      int max_tap = 0;
+      for (int itap = 0; itap < *taps; ++itap) {
+        int isrc = first + itap;
+        double overlap = std::min(end, isrc + 1.0)
+                       - std::max(begin, (double)isrc);
+        int tap_weight = 0;
+        if (isrc < src_size && overlap > 0) {
+          tap_weight = (int)floor(overlap / scale * one + 0.5);
+        }
+        (*index)[idst * *taps + itap] = std::min(isrc, src_size - 1);
+        (*weight)[idst * *taps + itap] = tap_weight;
+        sum += tap_weight;
+        if (tap_weight > (*weight)[idst * *taps + max_tap]) {
+          max_tap = itap;
+        }
+      }
+      // Rounding leftovers go to the heaviest tap so flat areas stay flat.
+      (*weight)[idst * *taps + max_tap] += one - sum;
+    }
+  } else {
+    *taps = 2;
+    index->assign(dst_size * 2, 0);
+    weight->assign(dst_size * 2, 0);
+    for (int idst = 0; idst < dst_size; ++idst) {
+      // Pixel centres of both grids line up.
+      double position = (idst + 0.5) * scale - 0.5;
+      int isrc = (int)floor(position);
+      double alpha = position - isrc;
+      if (isrc < 0) {
+        isrc = 0;
+        alpha = 0;
+      }
+      if (isrc >= src_size - 1) {
+        isrc = src_size - 1;
+        alpha = 0;
+      }
+      int right_weight = (int)floor(alpha * one + 0.5);
+      (*index)[idst * 2] = isrc;
+      (*index)[idst * 2 + 1] = std::min(isrc + 1, src_size - 1);
+      (*weight)[idst * 2] = one - right_weight;
+      (*weight)[idst * 2 + 1] = right_weight;
+    }
+  }
+}
+
+// Filters one source row into padded_width_ int16 values at 15 fractional
+// bits.
+inline void Resizer::HorizontalPass(const Byte* input_row, short* row) {
+  const int* index = &col_index_[0];
+  const short* weight = &col_weight_[0];
+  for (int icol = 0; icol < padded_width_; icol += 4) {
+#ifdef __SSE2__
+    __m128i sum = _mm_setzero_si128();
+    for (int ipair = 0; ipair < col_pairs_; ++ipair) {
+      __m128i pixels = _mm_setr_epi16(
+          input_row[index[0]], input_row[index[1]],
+          input_row[index[2]], input_row[index[3]],
+          input_row[index[4]], input_row[index[5]],
+          input_row[index[6]], input_row[index[7]]);
+      __m128i weights = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(weight));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, weights));
+      index += 8;
+      weight += 8;
+    }
+    sum = _mm_srai_epi32(sum, 1);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(row + icol),
+                     _mm_packs_epi32(sum, sum));
+#else
+    int sum[4] = {0, 0, 0, 0};
+    for (int ipair = 0; ipair < col_pairs_; ++ipair) {
+      for (int icell = 0; icell < 4; ++icell) {
+        sum[icell] += input_row[index[2 * icell]] * weight[2 * icell]
+                    + input_row[index[2 * icell + 1]] * weight[2 * icell + 1];
+      }
+      index += 8;
+      weight += 8;
+    }
+    for (int icell = 0; icell < 4; ++icell) {
+      row[icol + icell] = static_cast<short>(sum[icell] >> 1);
+    }
+#endif
+  }
+}
+
+// Blends the 2 * row_pairs_ window rows of one output row.
+inline void Resizer::VerticalPass(const short* const* rows,
+                                  const short* weight,
+                                  Byte* resized_row) {
+  const int round = 1 << (2 * kResizeBits - 2);
+  const int shift = 2 * kResizeBits - 1;
+  int dst_width = options_.dst_width_;
+  int icol = 0;
+#ifdef __SSE2__
+  for (; icol + 8 <= dst_width; icol += 8) {
+    __m128i low = _mm_set1_epi32(round);
+    __m128i high = low;
+    for (int ipair = 0; ipair < row_pairs_; ++ipair) {
+      __m128i first = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(rows[2 * ipair] + icol));
+      __m128i second = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(rows[2 * ipair + 1] + icol));
+      __m128i weights = _mm_set1_epi32(
+          (weight[2 * ipair + 1] << 16) | (weight[2 * ipair] & 0xffff));
+      low = _mm_add_epi32(low, _mm_madd_epi16(
+          _mm_unpacklo_epi16(first, second), weights));
+      high = _mm_add_epi32(high, _mm_madd_epi16(
+          _mm_unpackhi_epi16(first, second), weights));
+    }
+    __m128i value = _mm_packs_epi32(_mm_srai_epi32(low, shift),
+                                    _mm_srai_epi32(high, shift));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(resized_row + icol),
+                     _mm_packus_epi16(value, value));
+  }
+#endif
+  for (; icol < dst_width; ++icol) {
+    int sum = round;
+    for (int itap = 0; itap < 2 * row_pairs_; ++itap) {
+      sum += rows[itap][icol] * weight[itap];
+    }
+    int value = sum >> shift;
+    resized_row[icol] = static_cast<Byte>(
+        value < 0 ? 0 : (value > 255 ? 255 : value));
+  }
+}
+
+inline bool Resizer::Process(const std::shared_ptr<ImageByte>& input_image,
+                             std::shared_ptr<ImageByte> resized_image) {
+  if (input_image->GetHeight() != options_.src_height_
+      || input_image->GetWidth() != options_.src_width_
+      || resized_image->GetHeight() != options_.dst_height_
+      || resized_image->GetWidth() != options_.dst_width_
+      || input_image->GetChannel() != resized_image->GetChannel()) {
+    std::cout << "region doesn't match" << std::endl;
+    return false;
+  }
+  LCC_CV_PROFILE_SCOPE(kResize);
+  LCC_CV_PROFILE_PIXELS(kResize, resized_image->GetSize());
+  // The taps of one output row are consecutive source rows, and the first
+  // tap never moves back, so source row r can live in slot r % row_taps_
+  // until no later output row needs it.
+  std::vector<short> window((size_t)row_taps_ * padded_width_);
+  std::vector<int> window_row(row_taps_);
+  std::vector<const short*> rows(2 * row_pairs_);
+  LCC_CV_PROFILE_BYTES(kResize, window.size() * sizeof(short));
+  for (int ichan = 0; ichan < input_image->GetChannel(); ++ichan) {
+    std::fill(window_row.begin(), window_row.end(), -1);
+    for (int idst = 0; idst < options_.dst_height_; ++idst) {
+      const int* index = &row_index_[(size_t)idst * 2 * row_pairs_];
+      for (int itap = 0; itap < 2 * row_pairs_; ++itap) {
+        int isrc = index[itap];
+        int slot = isrc % row_taps_;
+        short* row = &window[(size_t)slot * padded_width_];
+        if (window_row[slot] != isrc) {
+          HorizontalPass(input_image->GetRow(isrc, ichan), row);
+          window_row[slot] = isrc;
+        }
+        rows[itap] = row;
+      }
+      VerticalPass(&rows[0], &row_weight_[(size_t)idst * 2 * row_pairs_],
+                   resized_image->GetRow(idst, ichan));
+    }
+  }
+  return true;
+}
+
+} // namespace lcc_cv
+
+#endif // LCC_CV_RESIZE_RESIZE_H
@@ -0,0 +1,473 @@
+#ifndef LCC_CV_STREAM_STREAM_H
+#define LCC_CV_STREAM_STREAM_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "common/type.h"
+#include "common/ring_buffer.h"
+
+// Pipelined executor for a continuous stream of frames. A frame is first
+// converted into an ImageByte (e.g. by CvMat2Image) and then passed through
+// the added stages (e.g. Filter::Process, then an edge detector). Every
+// stage runs on its own worker threads, so consecutive frames occupy
+// different stages at the same time. Raising a stage's parallelism raises
+// throughput when it is the bottleneck; a larger queue_capacity_ absorbs
+// bursts at the cost of latency. A stage added with AddBatchStage gets up
+// to batch_size_ frames per call, which amortizes per-call overhead (e.g.
+// one dispatch to an accelerator) at the cost of frames waiting for their
+// batch. A worker waits for a full batch only while frames it could take
+// are still on their way, so a producer that waits for each result before
+// submitting the next one still gets it, in a batch of one.
+//
+// All images come from a fixed pool allocated in Start(). Intermediate
+// images are recycled by the executor; images returned by Fetch must be
+// handed back with Release. A frame holds at most two images at a time, so
+// Submit admits no more than half the pool (minus a queue of results held
+// by the consumer) and blocks beyond that (backpressure). Without this cap,
+// frames finishing out of order could fill the pool while waiting for an
+// earlier frame that then never gets an image.
+//
+// Submit/TrySubmit/Finish are meant for one producer thread and
+// Fetch/GetStats for one consumer thread. Stage functions run concurrently
+// when their parallelism is above one and must be reentrant.
+
+namespace lcc_cv {
+
+struct StreamOptions {
+  int height_;
+  int width_;
+  int channel_;
+  // Frames buffered between two stages.
+  int queue_capacity_;
+  int convert_threads_;
+  // Frames per call of a batch stage, at least 1.
+  int batch_size_;
+  // Number of pooled images, 0 sizes it so every stage can stay busy.
+  // Other values are raised to 2 + queue_capacity_, the least that lets
+  // one frame through while the consumer holds a queue of results.
+  int pool_size_;
+};
+
+struct StreamResult {
+  uint64_t frame_id_;
+  uint64_t latency_ns_;
+  std::shared_ptr<ImageByte> image_;
+};
+
+struct StreamStats {
+  uint64_t frames_;
+  double fps_;
+  uint64_t latency_p50_ns_;
+  uint64_t latency_p90_ns_;
+  uint64_t latency_p99_ns_;
+  uint64_t latency_max_ns_;
+};
+
+typedef std::function<void(const std::shared_ptr<ImageByte>&,
+                           std::shared_ptr<ImageByte>)> StreamStage;
+// Processes inputs[i] into outputs[i] for every frame of the batch.
+typedef std::function<void(const std::vector<std::shared_ptr<ImageByte> >&,
+                           const std::vector<std::shared_ptr<ImageByte> >&)>
+    StreamBatchStage;
+
+const int kStreamLatencySamples = 4096;
+
+template<class Input>
+class StreamExecutor {
+ public:
+  typedef std::function<void(const Input&,
+                             std::shared_ptr<ImageByte>)> ConvertStage;
+  StreamExecutor() : started_(false) {
+    in_flight_.store(0);
+    submitted_.store(0);
+  }
+  ~StreamExecutor() {
+    Stop();
+  }
+  void Init(StreamOptions stream_options, ConvertStage convert);
+  void AddStage(StreamStage stage, int parallelism);
+  void AddBatchStage(StreamBatchStage stage, int parallelism);
+  void Start();
+  // Blocks while the pipeline is full. Returns false without taking the
+  // input when the executor is not started or Finish/Stop was called.
+  bool Submit(const Input& input);
+  // Returns false instead of blocking when the pipeline is full.
+  bool TrySubmit(const Input& input);
+  // Returns results in submission order; false once Finish was called and
+  // every frame has been fetched.
+  bool Fetch(StreamResult* result);
+  void Release(std::shared_ptr<ImageByte> image);
+  // No more input; frames in flight still reach Fetch.
+  void Finish();
+  // Drops frames in flight and joins the workers.
+  void Stop();
+  StreamStats GetStats();
+ private:
+  struct InputItem {
+    uint64_t frame_id_;
+    uint64_t submit_ns_;
+    Input input_;
+  };
+  struct FrameItem {
+    uint64_t frame_id_;
+    uint64_t submit_ns_;
+    std::shared_ptr<ImageByte> image_;
+  };
+  uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  void ConvertWorker();
+  void StageWorker(int istage);
+  bool PopBatch(int istage, std::vector<FrameItem>* frames);
+  void WorkerDone(int istage);
+  StreamOptions options_;
+  ConvertStage convert_;
+  std::vector<StreamBatchStage> stages_;
+  std::vector<int> batch_sizes_;
+  std::vector<int> parallelism_;
+  std::unique_ptr<RingBuffer<InputItem> > input_queue_;
+  // frame_queues_[i] feeds stage i, the last one feeds Fetch.
+  std::vector<std::unique_ptr<RingBuffer<FrameItem> > > frame_queues_;
+  std::unique_ptr<RingBuffer<std::shared_ptr<ImageByte> > > pool_;
+  // Live workers per step, step 0 being the conversion.
+  std::unique_ptr<std::atomic<int>[]> running_;
+  // Frames pushed into each of frame_queues_, against frames submitted.
+  std::unique_ptr<std::atomic<uint64_t>[]> pushed_;
+  std::atomic<uint64_t> submitted_;
+  std::vector<std::thread> workers_;
+  bool started_;
+  // Frames between Submit and Fetch.
+  std::atomic<int> in_flight_;
+  int max_in_flight_;
+  uint64_t next_submit_id_;
+  uint64_t next_fetch_id_;
+  std::map<uint64_t, FrameItem> pending_;
+  uint64_t start_ns_;
+  uint64_t last_fetch_ns_;
+  uint64_t fetched_;
+  std::vector<uint64_t> latencies_;
+};
+
+template<class Input>
+void StreamExecutor<Input>::Init(StreamOptions stream_options,
+                                 ConvertStage convert) {
+  options_ = stream_options;
+  options_.queue_capacity_ = std::max(1, options_.queue_capacity_);
+  options_.convert_threads_ = std::max(1, options_.convert_threads_);
+  options_.batch_size_ = std::max(1, options_.batch_size_);
+  convert_ = convert;
+  stages_.clear();
+  batch_sizes_.clear();
+  parallelism_.clear();
+}
+
+template<class Input>
+void StreamExecutor<Input>::AddStage(StreamStage stage, int parallelism) {
+  // Runs as a batch stage that always gets a single frame.
+  stages_.push_back([stage](
+      const std::vector<std::shared_ptr<ImageByte> >& inputs,
+      const std::vector<std::shared_ptr<ImageByte> >& outputs) {
+    for (size_t iframe = 0; iframe < inputs.size(); ++iframe) {
+      stage(inputs[iframe], outputs[iframe]);
+    }
+  });
+  batch_sizes_.push_back(1);
+  parallelism_.push_back(std::max(1, parallelism));
+}
+
+template<class Input>
+void StreamExecutor<Input>::AddBatchStage(StreamBatchStage stage,
+                                          int parallelism) {
+  stages_.push_back(stage);
+  batch_sizes_.push_back(options_.batch_size_);
+  parallelism_.push_back(std::max(1, parallelism));
+}
+
+template<class Input>
+void StreamExecutor<Input>::Start() {
+  int steps = stages_.size() + 1;
+  // Frames the workers hold at once, a whole batch per batch worker.
+  int held = options_.convert_threads_;
+  for (size_t istage = 0; istage < parallelism_.size(); ++istage) {
+    held += parallelism_[istage] * batch_sizes_[istage];
+  }
+  // Enough frames in flight to fill every queue and keep every worker busy.
+  int pool_size = options_.pool_size_;
+  if (pool_size <= 0) {
+    pool_size = 2 * (options_.queue_capacity_ * (steps + 1) + held)
+              + options_.queue_capacity_;
+  }
+  pool_size = std::max(pool_size, 2 + options_.queue_capacity_);
+  max_in_flight_ = (pool_size - options_.queue_capacity_) / 2;
+  in_flight_.store(0);
+  input_queue_.reset(new RingBuffer<InputItem>(options_.queue_capacity_));
+  frame_queues_.clear();
+  for (int istep = 0; istep < steps; ++istep) {
+    frame_queues_.push_back(std::unique_ptr<RingBuffer<FrameItem> >(
+        new RingBuffer<FrameItem>(options_.queue_capacity_)));
+  }
+  pool_.reset(new RingBuffer<std::shared_ptr<ImageByte> >(pool_size));
+  for (int ibuffer = 0; ibuffer < pool_size; ++ibuffer) {
+    pool_->TryPush(std::shared_ptr<ImageByte>(new ImageByte(
+        options_.height_, options_.width_, options_.channel_)));
+  }
+  running_.reset(new std::atomic<int>[steps]);
+  running_[0].store(options_.convert_threads_);
+  for (int istage = 0; istage < (int)stages_.size(); ++istage) {
+    running_[istage + 1].store(parallelism_[istage]);
+  }
+  pushed_.reset(new std::atomic<uint64_t>[steps]);
+  for (int istep = 0; istep < steps; ++istep) {
+    pushed_[istep].store(0);
+  }
+  submitted_.store(0);
+  next_submit_id_ = 0;
+  next_fetch_id_ = 0;
+  pending_.clear();
+  fetched_ = 0;
+  latencies_.clear();
+  start_ns_ = Now();
+  last_fetch_ns_ = start_ns_;
+  started_ = true;
+  for (int ithread = 0; ithread < options_.convert_threads_; ++ithread) {
+    workers_.push_back(std::thread(&StreamExecutor::ConvertWorker, this));
+  }
+  for (int istage = 0; istage < (int)stages_.size(); ++istage) {
+    for (int ithread = 0; ithread < parallelism_[istage]; ++ithread) {
+      workers_.push_back(std::thread(&StreamExecutor::StageWorker,
+                                     this, istage));
+    }
+  }
+}
+
+template<class Input>
+bool StreamExecutor<Input>::Submit(const Input& input) {
+  if (!started_ || input_queue_->IsClosed()) {
+    return false;
+  }
+  // Only the producer raises in_flight_, so checking before the increment
+  // cannot overshoot.
+  while (in_flight_.load() >= max_in_flight_) {
+    if (input_queue_->IsClosed()) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  InputItem item;
+  item.frame_id_ = next_submit_id_;
+  item.submit_ns_ = Now();
+  item.input_ = input;
+  in_flight_.fetch_add(1);
+  submitted_.fetch_add(1);
+  if (!input_queue_->Push(item)) {
+    in_flight_.fetch_sub(1);
+    submitted_.fetch_sub(1);
+    return false;
+  }
+  ++next_submit_id_;
+  return true;
+}
+
+template<class Input>
+bool StreamExecutor<Input>::TrySubmit(const Input& input) {
+  if (!started_ || input_queue_->IsClosed()
+      || in_flight_.load() >= max_in_flight_) {
+    return false;
+  }
+  InputItem item;
+  item.frame_id_ = next_submit_id_;
+  item.submit_ns_ = Now();
+  item.input_ = input;
+  in_flight_.fetch_add(1);
+  submitted_.fetch_add(1);
+  if (!input_queue_->TryPush(item)) {
+    in_flight_.fetch_sub(1);
+    submitted_.fetch_sub(1);
+    return false;
+  }
+  ++next_submit_id_;
+  return true;
+}
+
+template<class Input>
+bool StreamExecutor<Input>::Fetch(StreamResult* result) {
+  RingBuffer<FrameItem>& output = *frame_queues_.back();
+  typename std::map<uint64_t, FrameItem>::iterator it =
+      pending_.find(next_fetch_id_);
+  while (it == pending_.end()) {
+    FrameItem item;
+    if (!output.Pop(&item)) {
+      if (pending_.empty()) {
+        return false;
+      }
+      it = pending_.begin();
+      break;
+    }
+    pending_[item.frame_id_] = item;
+    it = pending_.find(next_fetch_id_);
+  }
+  FrameItem item = it->second;
+  pending_.erase(it);
+  in_flight_.fetch_sub(1);
+  next_fetch_id_ = item.frame_id_ + 1;
+  last_fetch_ns_ = Now();
+  result->frame_id_ = item.frame_id_;
+  result->latency_ns_ = last_fetch_ns_ - item.submit_ns_;
+  result->image_ = item.image_;
+  if (latencies_.size() < kStreamLatencySamples) {
+    latencies_.push_back(result->latency_ns_);
+  } else {
+    latencies_[fetched_ % kStreamLatencySamples] = result->latency_ns_;
+  }
+  ++fetched_;
+  return true;
+}
+
+template<class Input>
+void StreamExecutor<Input>::Release(std::shared_ptr<ImageByte> image) {
+  pool_->TryPush(image);
+}
+
+template<class Input>
+void StreamExecutor<Input>::Finish() {
+  if (started_) {
+    input_queue_->Close();
+  }
+}
+
+template<class Input>
+void StreamExecutor<Input>::Stop() {
+  if (!started_) {
+    return;
+  }
+  input_queue_->Close();
+  for (size_t iqueue = 0; iqueue < frame_queues_.size(); ++iqueue) {
+    frame_queues_[iqueue]->Close();
+  }
+  pool_->Close();
+  for (size_t ithread = 0; ithread < workers_.size(); ++ithread) {
+    workers_[ithread].join();
+  }
+  workers_.clear();
+  started_ = false;
+}
+
+template<class Input>
+StreamStats StreamExecutor<Input>::GetStats() {
+  StreamStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.frames_ = fetched_;
+  if (last_fetch_ns_ > start_ns_) {
+    stats.fps_ = fetched_ * 1e9 / (last_fetch_ns_ - start_ns_);
+  }
+  if (latencies_.empty()) {
+    return stats;
+  }
+  std::vector<uint64_t> sorted(latencies_);
+  std::sort(sorted.begin(), sorted.end());
+  int last = sorted.size() - 1;
+  stats.latency_p50_ns_ = sorted[last * 50 / 100];
+  stats.latency_p90_ns_ = sorted[last * 90 / 100];
+  stats.latency_p99_ns_ = sorted[last * 99 / 100];
+  stats.latency_max_ns_ = sorted[last];
+  return stats;
+}
+
+template<class Input>
+void StreamExecutor<Input>::ConvertWorker() {
+  RingBuffer<FrameItem>& output = *frame_queues_[0];
+  InputItem input;
+  while (input_queue_->Pop(&input)) {
+    FrameItem frame;
+    if (!pool_->Pop(&frame.image_)) {
+      return;
+    }
+    convert_(input.input_, frame.image_);
+    frame.frame_id_ = input.frame_id_;
+    frame.submit_ns_ = input.submit_ns_;
+    if (!output.Push(frame)) {
+      return;
+    }
+    pushed_[0].fetch_add(1);
+  }
+  WorkerDone(0);
+}
+
+template<class Input>
+void StreamExecutor<Input>::StageWorker(int istage) {
+  RingBuffer<FrameItem>& output = *frame_queues_[istage + 1];
+  std::vector<FrameItem> frames;
+  std::vector<std::shared_ptr<ImageByte> > inputs;
+  std::vector<std::shared_ptr<ImageByte> > outputs;
+  while (PopBatch(istage, &frames)) {
+    inputs.resize(frames.size());
+    outputs.resize(frames.size());
+    for (size_t iframe = 0; iframe < frames.size(); ++iframe) {
+      inputs[iframe] = frames[iframe].image_;
+      if (!pool_->Pop(&outputs[iframe])) {
+        return;
+      }
+    }
+    stages_[istage](inputs, outputs);
+    for (size_t iframe = 0; iframe < frames.size(); ++iframe) {
+      pool_->TryPush(inputs[iframe]);
+      frames[iframe].image_ = outputs[iframe];
+      if (!output.Push(frames[iframe])) {
+        return;
+      }
+      pushed_[istage + 1].fetch_add(1);
+    }
+  }
+  WorkerDone(istage + 1);
+}
+
+template<class Input>
+bool StreamExecutor<Input>::PopBatch(int istage,
+                                     std::vector<FrameItem>* frames) {
+  RingBuffer<FrameItem>& input = *frame_queues_[istage];
+  frames->clear();
+  FrameItem frame;
+  if (!input.Pop(&frame)) {
+    return false;
+  }
+  frames->push_back(frame);
+  while ((int)frames->size() < batch_sizes_[istage]) {
+    if (input.TryPop(&frame)) {
+      frames->push_back(frame);
+      continue;
+    }
+    // Once every submitted frame has reached this queue, waiting for more
+    // would stall until the producer submits again, which it may only do
+    // after fetching these frames.
+    if (input.IsClosed()
+        || pushed_[istage].load() >= submitted_.load()) {
+      if (input.TryPop(&frame)) {
+        frames->push_back(frame);
+        continue;
+      }
+      break;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+template<class Input>
+void StreamExecutor<Input>::WorkerDone(int istep) {
+  // The last worker of a step closes the queue it was feeding, after all
+  // of its pushes, so the next step drains it completely.
+  if (running_[istep].fetch_sub(1) == 1) {
+    frame_queues_[istep]->Close();
+  }
+}
+
+} // namespace lcc_cv
+
+#endif // LCC_CV_STREAM_STREAM_H
@@ -0,0 +1,236 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "common/type.h"
+#include "filter/filter.h"
+#include "stream/stream.h"
+
+typedef std::shared_ptr<lcc_cv::ImageByte> ImagePtr;
+
+const int kHeight = 240;
+const int kWidth = 320;
+
+bool Check(bool condition, const char* message) {
+  if (!condition) {
+    std::cout << "FAILED: " << message << std::endl;
+  }
+  return condition;
+}
+
+double Seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Vertical step from 60 to 190 with +-10 noise.
+ImagePtr NoisyStep(int channel) {
+  ImagePtr image(new lcc_cv::ImageByte(kHeight, kWidth, channel));
+  for (int ichan = 0; ichan < channel; ++ichan) {
+    for (int irow = 0; irow < kHeight; ++irow) {
+      for (int icol = 0; icol < kWidth; ++icol) {
+        int base = icol < kWidth / 2 ? 60 : 190;
+        image->GetRow(irow, ichan)[icol] = base + rand() % 21 - 10;
+      }
+    }
+  }
+  return image;
+}
+
+lcc_cv::FilterOptions MakeOptions(int filter_type, float sigma) {
+  lcc_cv::FilterOptions options;
+  options.filter_type_ = filter_type;
+  options.kernel_size_ = 2 * static_cast<int>(ceil(2 * sigma)) + 1;
+  options.sigma_ = sigma;
+  options.sigma_color_ = 20;
+  return options;
+}
+
+bool SameImage(const ImagePtr& a, const ImagePtr& b) {
+  return memcmp(a->GetRow(0, 0), b->GetRow(0, 0), a->GetSize()) == 0;
+}
+
+// Mean row of the column pair straddling the step, inside the border.
+int StepHeight(const ImagePtr& image, int k) {
+  int sum = 0;
+  for (int irow = k; irow < kHeight - k; ++irow) {
+    sum += image->GetRow(irow, 0)[kWidth / 2]
+         - image->GetRow(irow, 0)[kWidth / 2 - 1];
+  }
+  return sum / (kHeight - 2 * k);
+}
+
+// Exact against grid mode: timing per spatial sigma (printed only), mean
+// absolute difference and how much of the step survives.
+bool BenchBilateral() {
+  bool ok = true;
+  ImagePtr input = NoisyStep(1);
+  float sigmas[3] = {2, 4, 8};
+  double exact_time[3];
+  double grid_time[3];
+  for (int isigma = 0; isigma < 3; ++isigma) {
+    lcc_cv::FilterOptions options =
+        MakeOptions(lcc_cv::kBilateralFilter, sigmas[isigma]);
+    lcc_cv::BilateralFilter exact;
+    exact.Init(options);
+    options.filter_type_ = lcc_cv::kBilateralGridFilter;
+    lcc_cv::BilateralFilter grid;
+    grid.Init(options);
+    ImagePtr exact_image(new lcc_cv::ImageByte(kHeight, kWidth, 1));
+    ImagePtr grid_image(new lcc_cv::ImageByte(kHeight, kWidth, 1));
+    double begin = Seconds();
+    exact.Process(input, exact_image);
+    double middle = Seconds();
+    grid.Process(input, grid_image);
+    double end = Seconds();
+    exact_time[isigma] = middle - begin;
+    grid_time[isigma] = end - middle;
+    int k = (options.kernel_size_ - 1) / 2;
+    double diff = 0;
+    for (int irow = k; irow < kHeight - k; ++irow) {
+      for (int icol = k; icol < kWidth - k; ++icol) {
+        diff += abs(exact_image->GetRow(irow, 0)[icol]
+                    - grid_image->GetRow(irow, 0)[icol]);
+      }
+    }
+    diff /= (kHeight - 2 * k) * (kWidth - 2 * k);
+    int exact_step = StepHeight(exact_image, k);
+    int grid_step = StepHeight(grid_image, k);
+    std::cout << "sigma " << sigmas[isigma]
+              << " kernel " << options.kernel_size_
+              << ": exact " << exact_time[isigma] * 1e3 << " ms"
+              << ", grid " << grid_time[isigma] * 1e3 << " ms"
+              << ", mean |diff| " << diff
+              << ", step exact " << exact_step
+              << " grid " << grid_step << std::endl;
+    ok &= Check(diff < 1.0, "grid close to exact");
+    ok &= Check(exact_step > 115 && grid_step > 115, "step preserved");
+  }
+  return ok;
+}
+
+// One grid mode filter shared by several threads, directly and as a
+// parallel stream stage, must give the serial result.
+bool TestShared() {
+  ImagePtr input = NoisyStep(3);
+  lcc_cv::BilateralFilter filter;
+  filter.Init(MakeOptions(lcc_cv::kBilateralGridFilter, 4));
+  ImagePtr expected(new lcc_cv::ImageByte(kHeight, kWidth, 3));
+  filter.Process(input, expected);
+  const int kThreads = 4;
+  std::vector<ImagePtr> outputs;
+  std::vector<std::thread> threads;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    outputs.push_back(ImagePtr(new lcc_cv::ImageByte(kHeight, kWidth, 3)));
+  }
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    ImagePtr output = outputs[ithread];
+    threads.push_back(std::thread([&filter, &input, output] {
+      filter.Process(input, output);
+    }));
+  }
+  bool ok = true;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    threads[ithread].join();
+    ok &= Check(SameImage(outputs[ithread], expected), "shared filter");
+  }
+
+  lcc_cv::StreamOptions options;
+  options.height_ = kHeight;
+  options.width_ = kWidth;
+  options.channel_ = 3;
+  options.queue_capacity_ = 2;
+  options.convert_threads_ = 1;
+  options.batch_size_ = 1;
+  options.pool_size_ = 0;
+  lcc_cv::StreamExecutor<ImagePtr> executor;
+  executor.Init(options, [](const ImagePtr& frame, ImagePtr image) {
+    memcpy(image->GetRow(0, 0), frame->GetRow(0, 0), frame->GetSize());
+  });
+  executor.AddStage([&filter](const ImagePtr& frame, ImagePtr image) {
+    filter.Process(frame, image);
+  }, 3);
+  executor.Start();
+  const int kFrames = 6;
+  std::thread producer([&executor, &input] {
+    for (int iframe = 0; iframe < kFrames; ++iframe) {
+      executor.Submit(input);
+    }
+    executor.Finish();
+  });
+  lcc_cv::StreamResult result;
+  int fetched = 0;
+  while (executor.Fetch(&result)) {
+    ok &= Check(SameImage(result.image_, expected), "shared stream stage");
+    executor.Release(result.image_);
+    ++fetched;
+  }
+  producer.join();
+  executor.Stop();
+  ok &= Check(fetched == kFrames, "every frame filtered");
+  return ok;
+}
+
+// Unset or tiny sigmas are raised to the mode's lower bound instead of
+// dividing by zero or allocating a huge grid.
+bool TestSigmaBounds() {
+  ImagePtr input = NoisyStep(1);
+  lcc_cv::FilterOptions options =
+      MakeOptions(lcc_cv::kBilateralGridFilter, 0.01);
+  options.sigma_color_ = 0;
+  lcc_cv::BilateralFilter grid;
+  grid.Init(options);
+  ImagePtr grid_image(new lcc_cv::ImageByte(kHeight, kWidth, 1));
+  grid.Process(input, grid_image);
+  options.filter_type_ = lcc_cv::kBilateralFilter;
+  options.sigma_ = NAN;
+  lcc_cv::BilateralFilter exact;
+  exact.Init(options);
+  ImagePtr exact_image(new lcc_cv::ImageByte(kHeight, kWidth, 1));
+  exact.Process(input, exact_image);
+  // With the smallest sigmas the exact filter keeps the image.
+  return Check(SameImage(exact_image, input), "tiny sigma keeps image");
+}
+
+// A large plane gets wider cells instead of a huge grid, and rebuilding
+// with the same storage does not grow it.
+bool TestGridCap() {
+  ImagePtr input(new lcc_cv::ImageByte(1500, 2000, 1));
+  memset(input->GetRow(0, 0), 90, input->GetSize());
+  std::vector<float> cells;
+  lcc_cv::BilateralGrid grid(lcc_cv::kBilateralGridMinSigma,
+                             lcc_cv::kBilateralGridMinSigmaColor, &cells);
+  grid.Build(input, 0);
+  bool ok = Check(cells.size() <= 2 * lcc_cv::kBilateralGridMaxCells,
+                  "grid capped");
+  ok &= Check(grid.GetSigmaSpace() > lcc_cv::kBilateralGridMinSigma,
+              "cells widened");
+  ok &= Check(fabs(grid.Slice(700, 900, 90) - 90.5) < 0.01,
+              "capped grid keeps flat field");
+  const float* storage = &cells[0];
+  size_t capacity = cells.capacity();
+  lcc_cv::BilateralGrid small(4, 20, &cells);
+  small.Build(NoisyStep(1), 0);
+  grid.Build(input, 0);
+  ok &= Check(&cells[0] == storage && cells.capacity() == capacity,
+              "storage reused");
+  return ok;
+}
+
+// Defined in header_link.cc, which includes the same headers again.
+bool HeaderLinkCheck();
+
+int main() {
+  srand(3);
+  bool ok = true;
+  ok &= BenchBilateral();
+  ok &= TestShared();
+  ok &= TestSigmaBounds();
+  ok &= TestGridCap();
+  ok &= Check(HeaderLinkCheck(), "headers link into two translation units");
+  std::cout << (ok ? "bilateral_test passed" : "bilateral_test failed")
+            << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+// Second translation unit of pyramid_test and bilateral_test: including
+// the headers here as well fails to link if any of their functions is not
+// inline.
+#include "common/type.h"
+#include "filter/filter.h"
+#include "pyramid/pyramid.h"
+#include "resize/resize.h"
+
+bool HeaderLinkCheck() {
+  std::shared_ptr<lcc_cv::ImageByte> image(new lcc_cv::ImageByte(4, 4, 1));
+  memset(image->GetRow(0, 0), 50, image->GetSize());
+  lcc_cv::ImagePyramid pyramid;
+  pyramid.Build(image, 3);
+  lcc_cv::ResizeOptions options;
+  options.resize_type_ = lcc_cv::kResizeBilinear;
+  options.src_height_ = 2;
+  options.src_width_ = 2;
+  options.dst_height_ = 3;
+  options.dst_width_ = 3;
+  lcc_cv::Resizer resizer;
+  resizer.Init(options);
+  std::shared_ptr<lcc_cv::ImageByte> resized(new lcc_cv::ImageByte(3, 3, 1));
+  lcc_cv::FilterOptions filter_options;
+  filter_options.filter_type_ = lcc_cv::kBilateralGridFilter;
+  filter_options.kernel_size_ = 1;
+  filter_options.sigma_ = 2;
+  filter_options.sigma_color_ = 20;
+  lcc_cv::BilateralFilter filter;
+  filter.Init(filter_options);
+  std::shared_ptr<lcc_cv::ImageByte> filtered(new lcc_cv::ImageByte(4, 4, 1));
+  filter.Process(image, filtered);
+  return resizer.Process(pyramid.GetLevel(1), resized)
+      && resized->GetData(1, 1, 0) == 50
+      && filtered->GetData(1, 1, 0) == 50;
+}
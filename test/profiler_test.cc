@@ -0,0 +1,390 @@
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common/type.h"
+#include "common/profiler.h"
+#include "filter/filter.h"
+
+// Built with LCC_CV_ENABLE_PROFILE, see test/CMakeLists.txt.
+#ifndef LCC_CV_ENABLE_PROFILE
+#error "profiler_test needs LCC_CV_ENABLE_PROFILE"
+#endif
+
+typedef std::shared_ptr<lcc_cv::ImageByte> ImagePtr;
+
+const int kHeight = 48;
+const int kWidth = 64;
+const int kChannel = 3;
+const int kKernelSize = 5;
+
+bool Check(bool condition, const char* message) {
+  if (!condition) {
+    std::cout << "FAILED: " << message << std::endl;
+  }
+  return condition;
+}
+
+double Seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ImagePtr RandomImage(int height, int width, int channel) {
+  ImagePtr image(new lcc_cv::ImageByte(height, width, channel));
+  for (int i = 0; i < image->GetSize(); ++i) {
+    image->GetRow(0, 0)[i] = rand() % 256;
+  }
+  return image;
+}
+
+lcc_cv::FilterOptions GaussOptions() {
+  lcc_cv::FilterOptions options;
+  options.filter_type_ = lcc_cv::kGaussFilter;
+  options.kernel_size_ = kKernelSize;
+  options.sigma_ = 1;
+  options.sigma_color_ = 0;
+  return options;
+}
+
+// Minimal recursive descent JSON checker, enough for the trace format.
+class JsonChecker {
+ public:
+  explicit JsonChecker(const std::string& text) : text_(text), pos_(0) {}
+  bool Valid() {
+    if (!Value()) {
+      return false;
+    }
+    SkipSpace();
+    return pos_ == text_.size();
+  }
+ private:
+  void SkipSpace() {
+    while (pos_ < text_.size() && isspace(text_[pos_])) {
+      ++pos_;
+    }
+  }
+  bool Accept(char c) {
+    SkipSpace();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+  bool Literal(const char* word) {
+    size_t length = strlen(word);
+    if (text_.compare(pos_, length, word) != 0) {
+      return false;
+    }
+    pos_ += length;
+    return true;
+  }
+  bool String() {
+    if (!Accept('"')) {
+      return false;
+    }
+    while (pos_ < text_.size() && text_[pos_] != '"') {
+      if (text_[pos_] == '\\') {
+        ++pos_;
+      } else if (static_cast<unsigned char>(text_[pos_]) < 0x20) {
+        return false;
+      }
+      ++pos_;
+    }
+    return Accept('"');
+  }
+  bool Number() {
+    size_t begin = pos_;
+    if (pos_ < text_.size() && text_[pos_] == '-') {
+      ++pos_;
+    }
+    size_t digits = pos_;
+    while (pos_ < text_.size() && isdigit(text_[pos_])) {
+      ++pos_;
+    }
+    if (pos_ == digits) {
+      return false;
+    }
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+      size_t fraction = ++pos_;
+      while (pos_ < text_.size() && isdigit(text_[pos_])) {
+        ++pos_;
+      }
+      if (pos_ == fraction) {
+        return false;
+      }
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+      ++pos_;
+      if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) {
+        ++pos_;
+      }
+      size_t exponent = pos_;
+      while (pos_ < text_.size() && isdigit(text_[pos_])) {
+        ++pos_;
+      }
+      if (pos_ == exponent) {
+        return false;
+      }
+    }
+    return pos_ > begin;
+  }
+  bool Value() {
+    SkipSpace();
+    if (pos_ >= text_.size()) {
+      return false;
+    }
+    char c = text_[pos_];
+    if (c == '{') {
+      ++pos_;
+      if (Accept('}')) {
+        return true;
+      }
+      do {
+        if (!String() || !Accept(':') || !Value()) {
+          return false;
+        }
+      } while (Accept(','));
+      return Accept('}');
+    }
+    if (c == '[') {
+      ++pos_;
+      if (Accept(']')) {
+        return true;
+      }
+      do {
+        if (!Value()) {
+          return false;
+        }
+      } while (Accept(','));
+      return Accept(']');
+    }
+    if (c == '"') {
+      return String();
+    }
+    if (c == 't') {
+      return Literal("true");
+    }
+    if (c == 'f') {
+      return Literal("false");
+    }
+    if (c == 'n') {
+      return Literal("null");
+    }
+    return Number();
+  }
+  const std::string& text_;
+  size_t pos_;
+};
+
+int CountEvents(const std::string& trace) {
+  int count = 0;
+  for (size_t pos = trace.find("\"ph\":\"X\""); pos != std::string::npos;
+       pos = trace.find("\"ph\":\"X\"", pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void RunGauss(int runs) {
+  lcc_cv::GaussFilter filter;
+  filter.Init(GaussOptions());
+  ImagePtr input = RandomImage(kHeight, kWidth, kChannel);
+  ImagePtr output(new lcc_cv::ImageByte(kHeight, kWidth, kChannel));
+  for (int irun = 0; irun < runs; ++irun) {
+    filter.Process(input, output);
+  }
+}
+
+// Runs waves of concurrent threads; every wave exits before the next
+// starts, so later waves reuse the slots of earlier ones.
+void RunWaves(int waves, int threads, int runs) {
+  for (int iwave = 0; iwave < waves; ++iwave) {
+    std::vector<std::thread> workers;
+    for (int ithread = 0; ithread < threads; ++ithread) {
+      workers.push_back(std::thread(RunGauss, runs));
+    }
+    for (int ithread = 0; ithread < threads; ++ithread) {
+      workers[ithread].join();
+    }
+  }
+}
+
+// Per-stage counts summed over threads, with exited threads' slots reused.
+bool TestThreadCounts() {
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  RunWaves(1, 4, 3);
+  RunWaves(5, 4, 1);
+  lcc_cv::ProfileSnapshot snapshot = profiler.Snapshot();
+  const lcc_cv::ProfileStats& process =
+      snapshot.stages_[lcc_cv::kFilterProcess];
+  uint64_t calls = 4 * 3 + 5 * 4;
+  int k = (kKernelSize - 1) / 2;
+  uint64_t inner = (uint64_t)(kHeight - 2 * k) * (kWidth - 2 * k) * kChannel;
+  bool ok = Check(process.calls_ == calls, "process calls");
+  ok &= Check(snapshot.stages_[lcc_cv::kFilterBoundary].calls_ == calls,
+              "boundary calls");
+  ok &= Check(process.pixels_ == calls * inner, "convolved pixels");
+  ok &= Check(process.bytes_ == calls * inner * kKernelSize * sizeof(float),
+              "kernel bytes once per call");
+  ok &= Check(process.nanos_ > 0, "process time");
+  // 24 threads ran, but besides the main thread's slot never more than 4
+  // at once.
+  ok &= Check(snapshot.threads_ <= 5, "exited threads' slots reused");
+  ok &= Check(snapshot.dropped_threads_ == 0, "no thread dropped");
+  return ok;
+}
+
+// More live threads than slots: the extra ones are counted, not recorded.
+bool TestDroppedThreads() {
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  const int kThreads = lcc_cv::kProfileMaxThreads + 6;
+  uint64_t calls_before =
+      profiler.Snapshot().stages_[lcc_cv::kResize].calls_;
+  std::atomic<int> recorded(0);
+  std::vector<std::thread> workers;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    workers.push_back(std::thread([&profiler, &recorded, kThreads] {
+      profiler.RecordTime(lcc_cv::kResize, profiler.Now(), 1);
+      recorded.fetch_add(1);
+      // Keep the slot until every thread has tried to get one.
+      while (recorded.load() < kThreads) {
+        std::this_thread::yield();
+      }
+    }));
+  }
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    workers[ithread].join();
+  }
+  lcc_cv::ProfileSnapshot snapshot = profiler.Snapshot();
+  // The main thread keeps one slot.
+  int recorded_threads = lcc_cv::kProfileMaxThreads - 1;
+  bool ok = Check(snapshot.threads_ == lcc_cv::kProfileMaxThreads,
+                  "every slot handed out");
+  ok &= Check(snapshot.dropped_threads_ == (uint64_t)(kThreads
+                                                      - recorded_threads),
+              "dropped threads counted");
+  ok &= Check(snapshot.stages_[lcc_cv::kResize].calls_
+              == calls_before + recorded_threads, "slotted threads recorded");
+  return ok;
+}
+
+// The ring keeps the newest events and counts the overwritten ones.
+bool TestEventRing() {
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  profiler.Reset();
+  const int kExtra = 100;
+  const int kEvents = lcc_cv::kProfileMaxEvents + kExtra;
+  for (int ievent = 0; ievent < kEvents; ++ievent) {
+    profiler.RecordTime(lcc_cv::kPyrUp, ievent, 1);
+  }
+  lcc_cv::ProfileSnapshot snapshot = profiler.Snapshot();
+  bool ok = Check(snapshot.stages_[lcc_cv::kPyrUp].calls_ == (uint64_t)kEvents,
+                  "every event counted");
+  ok &= Check(snapshot.dropped_events_ == (uint64_t)kExtra,
+              "overwritten events counted");
+  std::vector<lcc_cv::ProfileEvent> events;
+  for (int islot = 0; islot < snapshot.threads_; ++islot) {
+    std::vector<lcc_cv::ProfileEvent> slot_events = profiler.Events(islot);
+    events.insert(events.end(), slot_events.begin(), slot_events.end());
+  }
+  ok &= Check((int)events.size() == lcc_cv::kProfileMaxEvents, "ring full");
+  bool newest = !events.empty();
+  for (size_t ievent = 0; ievent < events.size() && newest; ++ievent) {
+    newest = events[ievent].stage_ == lcc_cv::kPyrUp
+          && events[ievent].begin_ns_ == kExtra + ievent;
+  }
+  ok &= Check(newest, "newest events kept in order");
+  std::string trace = profiler.ToChromeTrace();
+  ok &= Check(JsonChecker(trace).Valid(), "trace is valid json");
+  ok &= Check(CountEvents(trace) == lcc_cv::kProfileMaxEvents,
+              "trace exports the ring");
+  return ok;
+}
+
+// Exports while threads keep wrapping their rings must stay valid.
+bool TestConcurrentExport() {
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  profiler.Reset();
+  std::atomic<bool> done(false);
+  std::vector<std::thread> workers;
+  for (int ithread = 0; ithread < 3; ++ithread) {
+    workers.push_back(std::thread(RunGauss, 2));
+  }
+  std::thread recorder([&profiler, &done] {
+    for (int ievent = 0; ievent < 20 * lcc_cv::kProfileMaxEvents; ++ievent) {
+      profiler.RecordTime(lcc_cv::kPyrDown, profiler.Now(), 1);
+    }
+    done.store(true);
+  });
+  bool ok = true;
+  int exports = 0;
+  while (!done.load() || exports == 0) {
+    std::string trace = profiler.ToChromeTrace();
+    ok &= Check(JsonChecker(trace).Valid(), "concurrent trace is json");
+    profiler.Snapshot();
+    ++exports;
+  }
+  recorder.join();
+  for (size_t ithread = 0; ithread < workers.size(); ++ithread) {
+    workers[ithread].join();
+  }
+  return ok;
+}
+
+// Enabled against disabled GaussFilter::Process. A disabled build only
+// lacks the two scopes and the two counters per call, so their cost is
+// timed directly; the difference of two full runs is within run-to-run
+// noise.
+void ReportOverhead() {
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  lcc_cv::GaussFilter filter;
+  filter.Init(GaussOptions());
+  ImagePtr input = RandomImage(240, 320, 3);
+  ImagePtr output(new lcc_cv::ImageByte(240, 320, 3));
+  double process_time = 1e9;
+  for (int irepeat = 0; irepeat < 5; ++irepeat) {
+    double begin = Seconds();
+    filter.Process(input, output);
+    process_time = std::min(process_time, Seconds() - begin);
+  }
+  const int kCalls = 100000;
+  double begin = Seconds();
+  for (int icall = 0; icall < kCalls; ++icall) {
+    LCC_CV_PROFILE_SCOPE(lcc_cv::kFilterProcess);
+    {
+      LCC_CV_PROFILE_SCOPE(lcc_cv::kFilterBoundary);
+    }
+    LCC_CV_PROFILE_PIXELS(lcc_cv::kFilterProcess, 1);
+    LCC_CV_PROFILE_BYTES(lcc_cv::kFilterProcess, 1);
+  }
+  double profile_time = (Seconds() - begin) / kCalls;
+  profiler.Reset();
+  std::cout << "320x240x3 GaussFilter::Process " << process_time * 1e3
+            << " ms, profiling " << profile_time * 1e9 << " ns per call, "
+            << "overhead " << 100 * profile_time / (process_time - profile_time)
+            << "% (target < 1%)" << std::endl;
+}
+
+int main() {
+  srand(5);
+  lcc_cv::Profiler& profiler = lcc_cv::Profiler::Instance();
+  // Takes slot 0 for the main thread.
+  profiler.RecordTime(lcc_cv::kCvMat2Image, profiler.Now(), 0);
+  profiler.Reset();
+  bool ok = true;
+  ok &= TestThreadCounts();
+  ok &= TestDroppedThreads();
+  ok &= TestEventRing();
+  ok &= TestConcurrentExport();
+  ReportOverhead();
+  std::cout << (ok ? "profiler_test passed" : "profiler_test failed")
+            << std::endl;
+  return ok ? 0 : 1;
+}
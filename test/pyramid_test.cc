@@ -0,0 +1,257 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "common/type.h"
+#include "pyramid/pyramid.h"
+#include "resize/resize.h"
+
+typedef std::shared_ptr<lcc_cv::ImageByte> ImagePtr;
+
+bool Check(bool condition, const char* message) {
+  if (!condition) {
+    std::cout << "FAILED: " << message << std::endl;
+  }
+  return condition;
+}
+
+ImagePtr RandomImage(int height, int width, int channel) {
+  ImagePtr image(new lcc_cv::ImageByte(height, width, channel));
+  for (int i = 0; i < image->GetSize(); ++i) {
+    image->GetRow(0, 0)[i] = rand() % 256;
+  }
+  return image;
+}
+
+ImagePtr FlatImage(int height, int width, int channel, int value) {
+  ImagePtr image(new lcc_cv::ImageByte(height, width, channel));
+  memset(image->GetRow(0, 0), value, image->GetSize());
+  return image;
+}
+
+bool IsFlat(const ImagePtr& image, int value) {
+  for (int i = 0; i < image->GetSize(); ++i) {
+    if (image->GetRow(0, 0)[i] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+double Seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Compares PyrDown with a direct 5x5 convolution at every retained pixel.
+bool TestPyrDownReference() {
+  int kernel[5] = {1, 4, 6, 4, 1};
+  bool ok = true;
+  int sizes[3][2] = {{37, 53}, {2, 3}, {1, 1}};
+  for (int isize = 0; isize < 3; ++isize) {
+    int height = sizes[isize][0];
+    int width = sizes[isize][1];
+    ImagePtr input = RandomImage(height, width, 3);
+    ImagePtr down(new lcc_cv::ImageByte((height + 1) / 2, (width + 1) / 2, 3));
+    ok &= Check(lcc_cv::PyrDown(input, down), "PyrDown accepts size");
+    int max_error = 0;
+    for (int ichan = 0; ichan < 3; ++ichan) {
+      for (int irow = 0; irow < down->GetHeight(); ++irow) {
+        for (int icol = 0; icol < down->GetWidth(); ++icol) {
+          int sum = 0;
+          for (int krow = 0; krow < 5; ++krow) {
+            int row = lcc_cv::Reflect101(2 * irow + krow - 2, height);
+            for (int kcol = 0; kcol < 5; ++kcol) {
+              int col = lcc_cv::Reflect101(2 * icol + kcol - 2, width);
+              sum += kernel[krow] * kernel[kcol]
+                   * input->GetRow(row, ichan)[col];
+            }
+          }
+          int error = abs(((sum + 128) >> 8) - down->GetRow(irow, ichan)[icol]);
+          max_error = std::max(max_error, error);
+        }
+      }
+    }
+    ok &= Check(max_error == 0, "PyrDown matches 5x5 reference");
+  }
+  return ok;
+}
+
+bool TestPyrUpFlat() {
+  ImagePtr input = FlatImage(9, 7, 2, 77);
+  ImagePtr up(new lcc_cv::ImageByte(18, 14, 2));
+  bool ok = Check(lcc_cv::PyrUp(input, up), "PyrUp accepts size");
+  ok &= Check(IsFlat(up, 77), "PyrUp keeps flat field");
+  ImagePtr wrong(new lcc_cv::ImageByte(17, 14, 2));
+  ok &= Check(!lcc_cv::PyrUp(input, wrong), "PyrUp rejects size");
+  return ok;
+}
+
+bool TestResize() {
+  bool ok = true;
+  int types[2] = {lcc_cv::kResizeBilinear, lcc_cv::kResizeArea};
+  for (int itype = 0; itype < 2; ++itype) {
+    lcc_cv::ResizeOptions options;
+    options.resize_type_ = types[itype];
+    int dst_sizes[3][2] = {{23, 31}, {61, 97}, {80, 120}};
+    for (int isize = 0; isize < 3; ++isize) {
+      options.src_height_ = 61;
+      options.src_width_ = 97;
+      options.dst_height_ = dst_sizes[isize][0];
+      options.dst_width_ = dst_sizes[isize][1];
+      lcc_cv::Resizer resizer;
+      resizer.Init(options);
+      ImagePtr flat = FlatImage(61, 97, 2, 200);
+      ImagePtr resized(new lcc_cv::ImageByte(options.dst_height_,
+                                             options.dst_width_, 2));
+      ok &= Check(resizer.Process(flat, resized), "resize accepts size");
+      ok &= Check(IsFlat(resized, 200), "resize keeps flat field");
+    }
+    options.src_height_ = 61;
+    options.src_width_ = 97;
+    options.dst_height_ = 61;
+    options.dst_width_ = 97;
+    lcc_cv::Resizer resizer;
+    resizer.Init(options);
+    ImagePtr input = RandomImage(61, 97, 3);
+    ImagePtr resized(new lcc_cv::ImageByte(61, 97, 3));
+    resizer.Process(input, resized);
+    ok &= Check(memcmp(input->GetRow(0, 0), resized->GetRow(0, 0),
+                       input->GetSize()) == 0, "same size resize is identity");
+  }
+  // 2x2 area averages of a ramp.
+  lcc_cv::ResizeOptions options;
+  options.resize_type_ = lcc_cv::kResizeArea;
+  options.src_height_ = 4;
+  options.src_width_ = 4;
+  options.dst_height_ = 2;
+  options.dst_width_ = 2;
+  lcc_cv::Resizer resizer;
+  resizer.Init(options);
+  ImagePtr ramp(new lcc_cv::ImageByte(4, 4, 1));
+  for (int i = 0; i < 16; ++i) {
+    ramp->GetRow(0, 0)[i] = i * 10;
+  }
+  ImagePtr resized(new lcc_cv::ImageByte(2, 2, 1));
+  resizer.Process(ramp, resized);
+  const lcc_cv::Byte* value = resized->GetRow(0, 0);
+  ok &= Check(value[0] == 25 && value[1] == 45
+              && value[2] == 105 && value[3] == 125, "area averages");
+  return ok;
+}
+
+bool TestPyramidLevels() {
+  ImagePtr base = RandomImage(50, 70, 3);
+  std::shared_ptr<lcc_cv::ImageByte> held;
+  bool ok = true;
+  {
+    lcc_cv::ImagePyramid pyramid;
+    pyramid.Build(base, 10);
+    ok &= Check(pyramid.GetLevels() == 8, "levels stop at 1x1");
+    ok &= Check(pyramid.GetLevel(0) == base, "level 0 is the base");
+    ok &= Check(pyramid.GetLevel(7)->GetHeight() == 1
+                && pyramid.GetLevel(7)->GetWidth() == 1, "last level 1x1");
+    ImagePtr down(new lcc_cv::ImageByte(25, 35, 3));
+    lcc_cv::PyrDown(base, down);
+    held = pyramid.GetLevel(1);
+    ok &= Check(memcmp(held->GetRow(0, 0), down->GetRow(0, 0),
+                       down->GetSize()) == 0, "level 1 is PyrDown of base");
+    // A held level must survive both a rebuild and the pyramid itself.
+    pyramid.Build(FlatImage(50, 70, 3, 9), 10);
+    pyramid.Build(RandomImage(200, 300, 3), 4);
+    ok &= Check(memcmp(held->GetRow(0, 0), down->GetRow(0, 0),
+                       down->GetSize()) == 0, "held level untouched");
+  }
+  ImagePtr down(new lcc_cv::ImageByte(25, 35, 3));
+  lcc_cv::PyrDown(base, down);
+  ok &= Check(memcmp(held->GetRow(0, 0), down->GetRow(0, 0),
+                     down->GetSize()) == 0, "held level outlives pyramid");
+  return ok;
+}
+
+// Full pyramid versus its first level alone; the geometric series of the
+// shrinking levels predicts about 4 / 3.
+bool BenchPyramid() {
+  ImagePtr base = RandomImage(480, 640, 3);
+  ImagePtr down(new lcc_cv::ImageByte(240, 320, 3));
+  lcc_cv::ImagePyramid pyramid;
+  double level_time = 1e9;
+  double pyramid_time = 1e9;
+  for (int irepeat = 0; irepeat < 20; ++irepeat) {
+    double begin = Seconds();
+    lcc_cv::PyrDown(base, down);
+    double middle = Seconds();
+    pyramid.Build(base, 8);
+    double end = Seconds();
+    level_time = std::min(level_time, middle - begin);
+    pyramid_time = std::min(pyramid_time, end - middle);
+  }
+  // Timings only inform; the levels' sizes are what must hold.
+  std::cout << "640x480x3 PyrDown " << level_time * 1e3 << " ms, "
+            << pyramid.GetLevels() << "-level pyramid "
+            << pyramid_time * 1e3 << " ms, ratio "
+            << pyramid_time / level_time << std::endl;
+  size_t pixels = 0;
+  for (int ilevel = 1; ilevel < pyramid.GetLevels(); ++ilevel) {
+    pixels += pyramid.GetLevel(ilevel)->GetSize();
+  }
+  // 4 / 3 of the first level, plus the rounding up of odd sizes.
+  return Check(100 * pixels < 134 * (size_t)down->GetSize(),
+               "pyramid about 4 / 3 of its first level");
+}
+
+// One Resizer shared by several threads gives the serial result.
+bool TestSharedResizer() {
+  lcc_cv::ResizeOptions options;
+  options.resize_type_ = lcc_cv::kResizeArea;
+  options.src_height_ = 120;
+  options.src_width_ = 160;
+  options.dst_height_ = 45;
+  options.dst_width_ = 70;
+  lcc_cv::Resizer resizer;
+  resizer.Init(options);
+  const int kThreads = 4;
+  std::vector<ImagePtr> inputs;
+  std::vector<ImagePtr> expected;
+  std::vector<ImagePtr> outputs;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    inputs.push_back(RandomImage(120, 160, 3));
+    expected.push_back(ImagePtr(new lcc_cv::ImageByte(45, 70, 3)));
+    outputs.push_back(ImagePtr(new lcc_cv::ImageByte(45, 70, 3)));
+    resizer.Process(inputs[ithread], expected[ithread]);
+  }
+  std::vector<std::thread> threads;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    threads.push_back(std::thread([&resizer, &inputs, &outputs, ithread] {
+      for (int irepeat = 0; irepeat < 20; ++irepeat) {
+        resizer.Process(inputs[ithread], outputs[ithread]);
+      }
+    }));
+  }
+  bool ok = true;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    threads[ithread].join();
+    ok &= Check(memcmp(outputs[ithread]->GetRow(0, 0),
+                       expected[ithread]->GetRow(0, 0),
+                       expected[ithread]->GetSize()) == 0, "shared resizer");
+  }
+  return ok;
+}
+
+// Defined in header_link.cc, which includes the same headers again.
+bool HeaderLinkCheck();
+
+int main() {
+  srand(7);
+  bool ok = true;
+  ok &= TestPyrDownReference();
+  ok &= TestPyrUpFlat();
+  ok &= TestResize();
+  ok &= TestPyramidLevels();
+  ok &= TestSharedResizer();
+  ok &= Check(HeaderLinkCheck(), "headers link into two translation units");
+  ok &= BenchPyramid();
+  std::cout << (ok ? "pyramid_test passed" : "pyramid_test failed") << std::endl;
+  return ok ? 0 : 1;
+}
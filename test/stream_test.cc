@@ -0,0 +1,312 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "common/type.h"
+#include "common/ring_buffer.h"
+#include "stream/stream.h"
+
+typedef std::shared_ptr<lcc_cv::ImageByte> ImagePtr;
+
+const int kHeight = 12;
+const int kWidth = 16;
+const int kChannel = 2;
+
+bool Check(bool condition, const char* message) {
+  if (!condition) {
+    std::cout << "FAILED: " << message << std::endl;
+  }
+  return condition;
+}
+
+bool TestRingBuffer() {
+  lcc_cv::RingBuffer<int> ring(3);
+  bool ok = Check(ring.GetCapacity() == 4, "capacity rounds up to 4");
+  for (int i = 0; i < 4; ++i) {
+    ok &= Check(ring.TryPush(i), "push into free slot");
+  }
+  ok &= Check(!ring.TryPush(4), "push into full ring fails");
+  int value = -1;
+  ok &= Check(ring.TryPop(&value) && value == 0, "pop is fifo");
+  ok &= Check(ring.TryPush(4), "push after pop");
+  ok &= Check(ring.TryPop(&value) && value == 1, "pop leaves space");
+  ring.Close();
+  ok &= Check(!ring.TryPush(5), "try push after close fails");
+  ok &= Check(!ring.Push(5), "push after close fails");
+  for (int i = 2; i <= 4; ++i) {
+    ok &= Check(ring.Pop(&value) && value == i, "pop drains after close");
+  }
+  ok &= Check(!ring.Pop(&value), "pop on closed empty ring fails");
+  return ok;
+}
+
+bool TestRingBufferThreads() {
+  const int kThreads = 4;
+  const int kValues = 20000;
+  lcc_cv::RingBuffer<int> ring(64);
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+  std::vector<long long> sums(kThreads, 0);
+  std::vector<int> counts(kThreads, 0);
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    producers.push_back(std::thread([&ring, ithread] {
+      for (int i = 0; i < kValues; ++i) {
+        ring.Push(ithread * kValues + i + 1);
+      }
+    }));
+    consumers.push_back(std::thread([&ring, &sums, &counts, ithread] {
+      int value;
+      while (ring.Pop(&value)) {
+        sums[ithread] += value;
+        ++counts[ithread];
+      }
+    }));
+  }
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    producers[ithread].join();
+  }
+  ring.Close();
+  long long sum = 0;
+  int count = 0;
+  for (int ithread = 0; ithread < kThreads; ++ithread) {
+    consumers[ithread].join();
+    sum += sums[ithread];
+    count += counts[ithread];
+  }
+  long long total = (long long)kThreads * kValues;
+  bool ok = Check(count == total, "every value popped once");
+  ok &= Check(sum == total * (total + 1) / 2, "popped values intact");
+  return ok;
+}
+
+void Fill(const int& frame, ImagePtr image) {
+  for (int ichan = 0; ichan < kChannel; ++ichan) {
+    for (int irow = 0; irow < kHeight; ++irow) {
+      for (int icol = 0; icol < kWidth; ++icol) {
+        image->SetData(irow, icol, ichan,
+                       (frame + irow + icol + ichan) % 100);
+      }
+    }
+  }
+}
+
+void AddOne(const ImagePtr& input_image, ImagePtr output_image) {
+  for (int i = 0; i < input_image->GetSize(); ++i) {
+    output_image->GetRow(0, 0)[i] = input_image->GetRow(0, 0)[i] + 1;
+  }
+}
+
+void Double(const ImagePtr& input_image, ImagePtr output_image) {
+  for (int i = 0; i < input_image->GetSize(); ++i) {
+    output_image->GetRow(0, 0)[i] = input_image->GetRow(0, 0)[i] * 2;
+  }
+}
+
+lcc_cv::StreamOptions MakeOptions() {
+  lcc_cv::StreamOptions options;
+  options.height_ = kHeight;
+  options.width_ = kWidth;
+  options.channel_ = kChannel;
+  options.queue_capacity_ = 4;
+  options.convert_threads_ = 2;
+  options.batch_size_ = 1;
+  options.pool_size_ = 0;
+  return options;
+}
+
+bool CheckResult(const lcc_cv::StreamResult& result) {
+  int frame = result.frame_id_;
+  for (int ichan = 0; ichan < kChannel; ++ichan) {
+    for (int irow = 0; irow < kHeight; ++irow) {
+      for (int icol = 0; icol < kWidth; ++icol) {
+        int expected = ((frame + irow + icol + ichan) % 100 + 1) * 2;
+        if (result.image_->GetData(irow, icol, ichan) != expected) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool RunFrames(lcc_cv::StreamExecutor<int>* executor, int frames) {
+  std::thread producer([executor, frames] {
+    for (int iframe = 0; iframe < frames; ++iframe) {
+      executor->Submit(iframe);
+    }
+    executor->Finish();
+  });
+  lcc_cv::StreamResult result;
+  int fetched = 0;
+  bool ok = true;
+  while (executor->Fetch(&result)) {
+    ok &= Check((int)result.frame_id_ == fetched, "results in order");
+    ok &= Check(CheckResult(result), "result content");
+    executor->Release(result.image_);
+    ++fetched;
+  }
+  producer.join();
+  ok &= Check(fetched == frames, "every frame fetched");
+  lcc_cv::StreamStats stats = executor->GetStats();
+  ok &= Check((int)stats.frames_ == frames, "stats count frames");
+  ok &= Check(stats.latency_p50_ns_ <= stats.latency_p99_ns_
+              && stats.latency_p99_ns_ <= stats.latency_max_ns_,
+              "latency percentiles ordered");
+  return ok;
+}
+
+bool TestExecutor() {
+  lcc_cv::StreamExecutor<int> executor;
+  executor.Init(MakeOptions(), Fill);
+  executor.AddStage(AddOne, 3);
+  executor.AddStage(Double, 2);
+  executor.Start();
+  bool ok = RunFrames(&executor, 300);
+  executor.Stop();
+  return ok;
+}
+
+bool TestStopAndRestart() {
+  lcc_cv::StreamExecutor<int> executor;
+  executor.Init(MakeOptions(), Fill);
+  executor.AddStage(AddOne, 2);
+  executor.AddStage(Double, 2);
+  executor.Start();
+  for (int iframe = 0; iframe < 8; ++iframe) {
+    executor.TrySubmit(iframe);
+  }
+  // Frames are still in flight and never fetched.
+  executor.Stop();
+  executor.Start();
+  bool ok = RunFrames(&executor, 50);
+  executor.Stop();
+  return ok;
+}
+
+// Input after Finish or Stop is refused instead of silently dropped, and
+// does not leak an in-flight slot.
+bool TestSubmitAfterClose() {
+  lcc_cv::StreamExecutor<int> executor;
+  executor.Init(MakeOptions(), Fill);
+  executor.AddStage(AddOne, 1);
+  executor.AddStage(Double, 1);
+  bool ok = Check(!executor.Submit(0), "submit before start fails");
+  executor.Start();
+  ok &= Check(executor.Submit(0), "submit after start");
+  executor.Finish();
+  ok &= Check(!executor.Submit(1), "submit after finish fails");
+  ok &= Check(!executor.TrySubmit(1), "try submit after finish fails");
+  lcc_cv::StreamResult result;
+  ok &= Check(executor.Fetch(&result) && result.frame_id_ == 0
+              && CheckResult(result), "frame before finish fetched");
+  executor.Release(result.image_);
+  ok &= Check(!executor.Fetch(&result), "nothing after finish");
+  executor.Stop();
+  ok &= Check(!executor.Submit(1), "submit after stop fails");
+  ok &= Check(!executor.TrySubmit(1), "try submit after stop fails");
+  executor.Start();
+  ok &= RunFrames(&executor, 10);
+  executor.Stop();
+  return ok;
+}
+
+std::atomic<int> g_max_batch;
+std::atomic<int> g_batches;
+
+void DoubleBatch(const std::vector<ImagePtr>& input_images,
+                 const std::vector<ImagePtr>& output_images) {
+  int size = input_images.size();
+  int max_batch = g_max_batch.load();
+  while (size > max_batch
+         && !g_max_batch.compare_exchange_weak(max_batch, size)) {
+  }
+  g_batches.fetch_add(1);
+  for (int iframe = 0; iframe < size; ++iframe) {
+    Double(input_images[iframe], output_images[iframe]);
+  }
+}
+
+// Frame 0 is held in conversion until every frame is submitted, so the
+// batch stage sees frames still coming and must wait for a full batch.
+bool TestBatchStage() {
+  // Stays below the in-flight cap so every submit goes through.
+  const int kFrames = 24;
+  std::atomic<bool> all_submitted(false);
+  lcc_cv::StreamOptions options = MakeOptions();
+  options.batch_size_ = 4;
+  lcc_cv::StreamExecutor<int> executor;
+  executor.Init(options, [&all_submitted](const int& frame, ImagePtr image) {
+    while (frame == 0 && !all_submitted.load()) {
+      std::this_thread::yield();
+    }
+    Fill(frame, image);
+  });
+  executor.AddStage(AddOne, 2);
+  executor.AddBatchStage(DoubleBatch, 2);
+  g_max_batch.store(0);
+  g_batches.store(0);
+  executor.Start();
+  std::thread producer([&executor, &all_submitted] {
+    for (int iframe = 0; iframe < kFrames; ++iframe) {
+      executor.Submit(iframe);
+    }
+    all_submitted.store(true);
+    executor.Finish();
+  });
+  lcc_cv::StreamResult result;
+  int fetched = 0;
+  bool ok = true;
+  while (executor.Fetch(&result)) {
+    ok &= Check((int)result.frame_id_ == fetched, "batched results in order");
+    ok &= Check(CheckResult(result), "batched result content");
+    executor.Release(result.image_);
+    ++fetched;
+  }
+  producer.join();
+  executor.Stop();
+  ok &= Check(fetched == kFrames, "every batched frame fetched");
+  ok &= Check(g_max_batch.load() == 4, "full batches formed");
+  ok &= Check(g_batches.load() < kFrames, "frames share calls");
+
+  // A producer that waits for each result must not stall on a batch that
+  // can never fill.
+  g_max_batch.store(0);
+  executor.Start();
+  for (int iframe = 0; iframe < 10 && ok; ++iframe) {
+    ok &= Check(executor.Submit(iframe), "lockstep submit");
+    ok &= Check(executor.Fetch(&result) && CheckResult(result),
+                "lockstep fetch");
+    executor.Release(result.image_);
+  }
+  executor.Stop();
+  ok &= Check(g_max_batch.load() == 1, "lockstep batches of one");
+  return ok;
+}
+
+bool TestSmallPool() {
+  lcc_cv::StreamOptions options = MakeOptions();
+  options.queue_capacity_ = 1;
+  options.convert_threads_ = 1;
+  options.pool_size_ = 1;
+  lcc_cv::StreamExecutor<int> executor;
+  executor.Init(options, Fill);
+  executor.AddStage(AddOne, 1);
+  executor.AddStage(Double, 1);
+  executor.Start();
+  bool ok = RunFrames(&executor, 20);
+  executor.Stop();
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= TestRingBuffer();
+  ok &= TestRingBufferThreads();
+  ok &= TestExecutor();
+  ok &= TestStopAndRestart();
+  ok &= TestSubmitAfterClose();
+  ok &= TestBatchStage();
+  ok &= TestSmallPool();
+  std::cout << (ok ? "stream_test passed" : "stream_test failed") << std::endl;
+  return ok ? 0 : 1;
+}